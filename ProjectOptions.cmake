@@ -122,6 +122,9 @@ macro(decision_tree_setup_options)
   endif()
 
   option(decision_tree_BUILD_FUZZ_TESTS "Enable fuzz testing executable" ${DEFAULT_FUZZER})
+  option(decision_tree_BUILD_BENCHMARKS "Enable benchmarks executable" ${PROJECT_IS_TOP_LEVEL})
+  option(decision_tree_BUILD_CODEGEN "Build the decision_tree_codegen tool and decision_tree_generate_header"
+         ${PROJECT_IS_TOP_LEVEL})
 
 endmacro()
 
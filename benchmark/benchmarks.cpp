@@ -0,0 +1,486 @@
+// benchmarks [--max-rows <n>] [--any-max-rows <n>] [--repetitions <n>]
+//            [--output <file>]
+//
+// Times training, single and batch classification, classification with
+// missing data and pruning of decision_tree<array_sheet> and
+// any_decision_tree on synthetic datasets, and writes the results as JSON
+// to stdout or <file>. The datasets sweep one parameter at a time around a
+// base of 10^4 rows, 16 columns, 16 distinct values per column, 4 classes
+// and 10% missing observation values: rows from 10^3 to --max-rows
+// (default 10^5, up to 10^7), columns 4, 16 and 64, cardinality 2 to 2^16,
+// 2 to 16 classes and missing rates 0 to 0.5. The any engine is slower and
+// only runs datasets up to --any-max-rows rows (default 10^4). Every
+// measurement is repeated --repetitions times (default 5); min and median
+// are reported, so two runs can be diffed value by value.
+#include <algorithm>
+#include <array>
+#include <bit_factory/ml/decision_tree.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <version>
+
+#if defined __cpp_lib_generator
+#include <bit_factory/ml/any_decision_tree.hpp>
+#endif
+
+namespace {
+namespace benchmarks {
+
+struct dataset_options_t {
+  std::size_t rows = 10'000;
+  std::size_t columns = 16;
+  int cardinality = 16;
+  int classes = 4;
+  double missing_rate = 0.1;
+};
+
+// Column major would be faster to generate, but both engines read rows.
+// The class of a row is a function of its first three columns, with 10% of
+// the labels replaced by noise, so the trees have real structure and real
+// leaves.
+struct dataset_t {
+  dataset_options_t options;
+  std::vector<int> values;  // rows x columns
+  std::vector<int> labels;
+  std::vector<std::optional<int>> observations;  // observation_count x columns
+  std::size_t observation_count = 0;
+};
+
+[[nodiscard]] dataset_t generate(dataset_options_t const& options) {
+  std::mt19937_64 rng{options.rows * 131 + options.columns};
+  std::uniform_int_distribution<int> value{0, options.cardinality - 1};
+  std::uniform_int_distribution<int> noise_class{0, options.classes - 1};
+  std::bernoulli_distribution noise{0.1};
+  std::bernoulli_distribution missing{options.missing_rate};
+
+  dataset_t dataset{.options = options,
+                    .values = {},
+                    .labels = {},
+                    .observations = {},
+                    .observation_count = std::min(options.rows,
+                                                  std::size_t{10'000})};
+  auto label = [&](std::span<int const> row) {
+    auto const high = row[2 % row.size()] * 2 >= options.cardinality;
+    return (row[0] + 3 * row[1 % row.size()] + (high ? 1 : 0)) %
+           options.classes;
+  };
+  dataset.values.resize(options.rows * options.columns);
+  for (auto& v : dataset.values) v = value(rng);
+  dataset.labels.reserve(options.rows);
+  for (std::size_t row = 0; row < options.rows; ++row)
+    dataset.labels.push_back(
+        noise(rng) ? noise_class(rng)
+                   : label(std::span{dataset.values}.subspan(
+                         row * options.columns, options.columns)));
+  dataset.observations.reserve(dataset.observation_count * options.columns);
+  for (std::size_t i = 0; i < dataset.observation_count * options.columns;
+       ++i) {
+    auto const v = value(rng);
+    dataset.observations.push_back(missing(rng) ? std::nullopt
+                                                : std::optional<int>{v});
+  }
+  return dataset;
+}
+
+// One JSON object per measurement.
+struct result_t {
+  std::string_view engine;
+  std::string_view operation;
+  dataset_options_t dataset;
+  std::size_t items = 0;
+  std::vector<double> nanoseconds;
+};
+
+class report_t {
+ public:
+  explicit report_t(std::size_t repetitions) : repetitions_(repetitions) {}
+
+  // Runs f repetitions times and records its wall clock times. f processes
+  // items items and returns a checksum, which keeps its work alive.
+  void measure(std::string_view engine, std::string_view operation,
+               dataset_options_t const& dataset, std::size_t items, auto f) {
+    result_t result{.engine = engine,
+                    .operation = operation,
+                    .dataset = dataset,
+                    .items = items,
+                    .nanoseconds = {}};
+    for (std::size_t i = 0; i < repetitions_; ++i) {
+      auto const start = std::chrono::steady_clock::now();
+      checksum_ += static_cast<double>(f());
+      auto const stop = std::chrono::steady_clock::now();
+      result.nanoseconds.push_back(
+          std::chrono::duration<double, std::nano>(stop - start).count());
+    }
+    std::ranges::sort(result.nanoseconds);
+    std::cerr << engine << ' ' << operation << " rows=" << dataset.rows
+              << " columns=" << dataset.columns << ": "
+              << result.nanoseconds.front() / 1e6 << " ms\n";
+    results_.push_back(std::move(result));
+  }
+
+  void write(std::ostream& os) const {
+    os << "{\n  \"library\": \"decision_tree\",\n"
+       << "  \"repetitions\": " << repetitions_ << ",\n"
+       << "  \"checksum\": " << checksum_ << ",\n"
+       << "  \"results\": [";
+    std::string_view separator = "\n";
+    for (auto const& result : results_) {
+      auto const min = result.nanoseconds.front();
+      auto const median = result.nanoseconds[result.nanoseconds.size() / 2];
+      os << std::exchange(separator, ",\n") << "    {\"engine\": \""
+         << result.engine << "\", \"operation\": \"" << result.operation
+         << "\", \"rows\": " << result.dataset.rows
+         << ", \"columns\": " << result.dataset.columns
+         << ", \"cardinality\": " << result.dataset.cardinality
+         << ", \"classes\": " << result.dataset.classes
+         << ", \"missing_rate\": " << result.dataset.missing_rate
+         << ", \"items\": " << result.items << ", \"min_ns\": " << min
+         << ", \"median_ns\": " << median << ", \"min_ns_per_item\": "
+         << min / static_cast<double>(std::max(result.items, std::size_t{1}))
+         << "}";
+    }
+    os << "\n  ]\n}\n";
+  }
+
+ private:
+  std::size_t repetitions_;
+  std::vector<result_t> results_;
+  double checksum_ = 0.0;
+};
+
+template <std::size_t Columns>
+void run_typed(report_t& report, dataset_t const& dataset) {
+  using sheet_t = bit_factory::ml::array_sheet<int, Columns>;
+  using decision_tree = bit_factory::ml::decision_tree<sheet_t>;
+  auto const& options = dataset.options;
+
+  typename decision_tree::rows_t rows(options.rows);
+  for (std::size_t row = 0; row < options.rows; ++row) {
+    std::ranges::copy(
+        std::span{dataset.values}.subspan(row * Columns, Columns),
+        rows[row].first.begin());
+    rows[row].second = dataset.labels[row];
+  }
+  std::vector<typename decision_tree::observation_t> observations(
+      dataset.observation_count);
+  for (std::size_t i = 0; i < observations.size(); ++i)
+    std::ranges::copy(
+        std::span{dataset.observations}.subspan(i * Columns, Columns),
+        observations[i].begin());
+  // Single and batch classification walk complete observations.
+  auto complete = observations;
+  for (std::size_t i = 0; i < complete.size(); ++i)
+    for (std::size_t column = 0; column < Columns; ++column)
+      complete[i][column] =
+          dataset.values[(i % options.rows) * Columns + column];
+
+  report.measure("decision_tree", "build_tree", options, options.rows, [&] {
+    return decision_tree::build_tree(rows).node_data.index();
+  });
+  auto const tree = decision_tree::build_tree(rows);
+  auto const compiled = decision_tree::compile(tree);
+
+  report.measure("decision_tree", "compile", options, 1, [&] {
+    return decision_tree::compile(tree).columns.size();
+  });
+  report.measure("decision_tree", "classify", options, complete.size(), [&] {
+    std::size_t found = 0;
+    for (auto const& observation : complete)
+      found += decision_tree::classify(tree, observation).size();
+    return found;
+  });
+  report.measure("decision_tree", "classify compiled", options,
+                 complete.size(), [&] {
+                   std::size_t found = 0;
+                   for (auto const& observation : complete)
+                     found += decision_tree::classify_leaf(compiled,
+                                                           observation);
+                   return found;
+                 });
+  std::vector<std::size_t> leaves(complete.size());
+  report.measure("decision_tree", "classify_batch", options, complete.size(),
+                 [&] {
+                   decision_tree::classify_batch(
+                       compiled,
+                       std::span<typename decision_tree::observation_t const>{
+                           complete},
+                       std::span{leaves});
+                   return leaves.back();
+                 });
+  report.measure("decision_tree", "classify_with_missing_data", options,
+                 observations.size(), [&] {
+                   double total = 0.0;
+                   for (auto const& observation : observations)
+                     total += decision_tree::result_counts_total(
+                         decision_tree::classify_with_missing_data(
+                             tree, observation));
+                   return total;
+                 });
+  std::vector<double> counts(compiled.predict_values.size());
+  report.measure("decision_tree", "classify_with_missing_data compiled",
+                 options, observations.size(), [&] {
+                   double total = 0.0;
+                   for (auto const& observation : observations) {
+                     decision_tree::classify_with_missing_data(
+                         compiled, observation, counts);
+                     total += counts.front();
+                   }
+                   return total;
+                 });
+  report.measure("decision_tree", "prune", options, 1, [&] {
+    return decision_tree::prune(tree, 0.1).node_data.index();
+  });
+}
+
+#if defined __cpp_lib_generator
+
+// A row of a dataset_t for any_decision_tree, the label as last column.
+struct any_row {
+  dataset_t const* dataset = nullptr;
+  std::size_t index = 0;
+  friend bool operator==(any_row const&, any_row const&) = default;
+};
+
+struct any_sheet {
+  dataset_t const* dataset = nullptr;
+  std::vector<any_row> rows;
+  // Column major copies of the values, handed out as column buffers. Empty
+  // for a sheet read through its rows only.
+  std::vector<std::vector<int>> columns;
+};
+
+struct any_observation {
+  std::optional<int> const* values = nullptr;
+};
+
+#endif
+
+}  // namespace benchmarks
+}  // namespace
+
+#if defined __cpp_lib_generator
+
+ANY_MODEL_MAP((benchmarks::any_row), bit_factory::ml::any_decision_tree::row) {
+  static bit_factory::ml::any_decision_tree::value<> subscript(
+      benchmarks::any_row const& self, std::size_t i) {
+    auto const columns = self.dataset->options.columns;
+    if (i < columns) return self.dataset->values[self.index * columns + i];
+    return self.dataset->labels[self.index];
+  };
+};
+
+ANY_MODEL_MAP((benchmarks::any_observation),
+              bit_factory::ml::any_decision_tree::observation) {
+  static std::optional<bit_factory::ml::any_decision_tree::value<>> subscript(
+      benchmarks::any_observation const& self, std::size_t i) {
+    if (auto const& v = self.values[i]) return *v;
+    return std::nullopt;
+  };
+};
+
+ANY_MODEL_MAP((benchmarks::any_sheet),
+              bit_factory::ml::any_decision_tree::sheet) {
+  static anyxx::any_forward_range<bit_factory::ml::any_decision_tree::row<>,
+                                  bit_factory::ml::any_decision_tree::row<>>
+  rows(benchmarks::any_sheet const& self) {  // NOLINT
+    return self.rows;
+  };
+  static std::string column_header(
+      [[maybe_unused]] benchmarks::any_sheet const& self, std::size_t index) {
+    return "x[" + std::to_string(index) + "]";
+  };
+  static std::size_t column_count(benchmarks::any_sheet const& self) {
+    return self.dataset->options.columns + 1;
+  };
+  static bit_factory::ml::any_decision_tree::column_buffer_t column_buffer(
+      benchmarks::any_sheet const& self, std::size_t index) {
+    if (index < self.columns.size())
+      return std::span<int const>{self.columns[index]};
+    return {};
+  };
+};
+
+#endif
+
+namespace {
+namespace benchmarks {
+
+void run_any([[maybe_unused]] report_t& report,
+             [[maybe_unused]] dataset_t const& dataset) {
+#if defined __cpp_lib_generator
+  namespace any_decision_tree = bit_factory::ml::any_decision_tree;
+  auto const& options = dataset.options;
+  any_sheet data{.dataset = &dataset, .rows = {}, .columns = {}};
+  for (std::size_t row = 0; row < options.rows; ++row)
+    data.rows.push_back({.dataset = &dataset, .index = row});
+  any_decision_tree::sheet<> const sheet = data;
+  auto columnar_data = data;
+  columnar_data.columns.resize(options.columns);
+  for (std::size_t column = 0; column < options.columns; ++column)
+    for (std::size_t row = 0; row < options.rows; ++row)
+      columnar_data.columns[column].push_back(
+          dataset.values[row * options.columns + column]);
+  any_decision_tree::sheet<> const columnar_sheet = columnar_data;
+  std::vector<any_observation> observations;
+  for (std::size_t i = 0; i < dataset.observation_count; ++i)
+    observations.push_back({&dataset.observations[i * options.columns]});
+  std::vector<std::vector<std::optional<int>>> complete_values;
+  std::vector<any_observation> complete;
+  for (std::size_t i = 0; i < dataset.observation_count; ++i) {
+    auto const row = std::span{dataset.values}.subspan(
+        (i % options.rows) * options.columns, options.columns);
+    complete_values.emplace_back(row.begin(), row.end());
+  }
+  for (auto const& values : complete_values)
+    complete.push_back({values.data()});
+
+  report.measure("any_decision_tree", "build_tree", options, options.rows,
+                 [&] {
+                   return any_decision_tree::build_tree(sheet)
+                       .node_data.index();
+                 });
+  report.measure("any_decision_tree", "build_tree_column_buffers", options,
+                 options.rows, [&] {
+                   return any_decision_tree::build_tree(columnar_sheet)
+                       .node_data.index();
+                 });
+  auto const tree = any_decision_tree::build_tree(sheet);
+  report.measure("any_decision_tree", "classify", options, complete.size(),
+                 [&] {
+                   std::size_t found = 0;
+                   for (auto const& observation : complete)
+                     found += any_decision_tree::classify(
+                                  tree, any_decision_tree::observation<>{
+                                            observation})
+                                  .size();
+                   return found;
+                 });
+  report.measure("any_decision_tree", "classify_with_missing_data", options,
+                 observations.size(), [&] {
+                   double total = 0.0;
+                   for (auto const& observation : observations)
+                     total += any_decision_tree::result_counts_total(
+                         any_decision_tree::classify_with_missing_data(
+                             tree,
+                             any_decision_tree::observation<>{observation}));
+                   return total;
+                 });
+  report.measure("any_decision_tree", "prune", options, 1, [&] {
+    return any_decision_tree::prune(tree, 0.1).node_data.index();
+  });
+#endif
+}
+
+void run(report_t& report, dataset_options_t const& options,
+         std::size_t any_max_rows) {
+  auto const dataset = generate(options);
+  switch (options.columns) {
+    case 4:
+      run_typed<4>(report, dataset);
+      break;
+    case 16:
+      run_typed<16>(report, dataset);
+      break;
+    case 64:
+      run_typed<64>(report, dataset);
+      break;
+    default:
+      throw std::invalid_argument("benchmarks: unsupported column count");
+  }
+  if (options.rows <= any_max_rows) run_any(report, dataset);
+}
+
+}  // namespace benchmarks
+}  // namespace
+
+int main(int argc, char** argv) {
+  using namespace benchmarks;
+  std::span const args{argv, static_cast<std::size_t>(argc)};
+  std::size_t max_rows = 100'000;
+  std::size_t any_max_rows = 10'000;
+  std::size_t repetitions = 5;
+  std::string output;
+  try {
+    for (std::size_t i = 1; i < args.size(); ++i) {
+      std::string_view const arg = args[i];
+      if (i + 1 == args.size())
+        throw std::invalid_argument("missing value of " + std::string{arg});
+      std::string_view const value = args[++i];
+      if (arg == "--max-rows")
+        max_rows = std::stoul(std::string{value});
+      else if (arg == "--any-max-rows")
+        any_max_rows = std::stoul(std::string{value});
+      else if (arg == "--repetitions")
+        repetitions = std::max(std::stoul(std::string{value}), 1UL);
+      else if (arg == "--output")
+        output = value;
+      else
+        throw std::invalid_argument("unknown argument " + std::string{arg});
+    }
+    if (max_rows > 10'000'000)
+      throw std::invalid_argument("--max-rows is at most 10000000");
+  } catch (std::exception const& e) {
+    std::cerr << "benchmarks: " << e.what()
+              << "\nusage: benchmarks [--max-rows <n>] [--any-max-rows <n>] "
+                 "[--repetitions <n>] [--output <file>]\n";
+    return 2;
+  }
+
+  try {
+    report_t report{repetitions};
+    dataset_options_t const base;
+    for (std::size_t rows = 1'000; rows <= max_rows; rows *= 10) {
+      auto options = base;
+      options.rows = rows;
+      run(report, options, any_max_rows);
+    }
+    for (auto const columns : {std::size_t{4}, std::size_t{64}}) {
+      auto options = base;
+      options.columns = columns;
+      run(report, options, any_max_rows);
+    }
+    for (int cardinality : {2, 256, 65'536}) {
+      auto options = base;
+      options.cardinality = cardinality;
+      run(report, options, any_max_rows);
+    }
+    for (int classes : {2, 16}) {
+      auto options = base;
+      options.classes = classes;
+      run(report, options, any_max_rows);
+    }
+    for (double missing_rate : {0.0, 0.5}) {
+      auto options = base;
+      options.missing_rate = missing_rate;
+      run(report, options, any_max_rows);
+    }
+
+    if (output.empty()) {
+      report.write(std::cout);
+    } else {
+      std::ofstream file{output, std::ios::trunc};
+      report.write(file);
+      file.close();
+      if (!file) {
+        std::cerr << "benchmarks: cannot write " << output << "\n";
+        return 1;
+      }
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "benchmarks: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
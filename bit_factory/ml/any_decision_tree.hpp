@@ -4,19 +4,34 @@
 #include <array>
 #include <bit_factory/anyxx.hpp>
 #include <bit_factory/anyxx_std.hpp>
+#include <bit_factory/ml/build_observer.hpp>
+#include <bit_factory/ml/lowered_tree.hpp>
+#include <bit_factory/ml/model_codegen.hpp>
+#include <bit_factory/ml/model_file.hpp>
+#include <bit_factory/ml/thread_pool.hpp>
 #include <cmath>
+#include <concepts>
+#include <cstdint>
 #include <format>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <memory_resource>
 #include <numeric>
 #include <optional>
 #include <ranges>
 #include <set>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
+#include <variant>
 #include <vector>
 
 // cppcheck-suppress-begin unknownMacro
@@ -25,6 +40,62 @@ namespace bit_factory::ml::any_decision_tree {
 
 struct tree_t;
 
+// A contiguous typed column of a sheet, in the order of its rows, holding
+// the values of the column with their own type. Sheets storing their
+// columns so may hand them out by column_buffer, which training then uses
+// as it is. The default, std::monostate, has training read the column
+// through the rows.
+using column_buffer_t =
+    std::variant<std::monostate, std::span<bool const>, std::span<int const>,
+                 std::span<std::int64_t const>, std::span<double const>,
+                 std::span<std::string const>>;
+
+// A column of training values being read into contiguous memory, see
+// training_set_t. It takes the type of its first value if that is one of
+// column_buffer_t, and refuses values of any other type.
+class typed_column_t {
+ public:
+  explicit typed_column_t(std::size_t size) : size_(size) {}
+
+  template <typename T>
+  [[nodiscard]] bool append(T const& x) {
+    if constexpr (std::constructible_from<column_buffer_t,
+                                          std::span<T const>>) {
+      if (std::holds_alternative<std::monostate>(values_))
+        values_ = std::make_unique<T[]>(size_);
+      if (auto* values = std::get_if<std::unique_ptr<T[]>>(&values_);
+          values && count_ < size_) {
+        (*values)[count_++] = x;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // std::monostate until all values are appended.
+  [[nodiscard]] column_buffer_t buffer() const {
+    return std::visit(
+        [&]<typename Values>(Values const& values) -> column_buffer_t {
+          if constexpr (std::same_as<Values, std::monostate>) {
+            return {};
+          } else {
+            if (count_ != size_) return {};
+            return std::span<typename Values::element_type const>{
+                values.get(), size_};
+          }
+        },
+        values_);
+  }
+
+ private:
+  std::size_t size_ = 0;
+  std::size_t count_ = 0;
+  std::variant<std::monostate, std::unique_ptr<bool[]>,
+               std::unique_ptr<int[]>, std::unique_ptr<std::int64_t[]>,
+               std::unique_ptr<double[]>, std::unique_ptr<std::string[]>>
+      values_;
+};
+
 #if defined(__clang__)
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-lambda-capture"
@@ -45,6 +116,27 @@ ANY(value,
                           }),
      ANY_METHOD_DEFAULTED(std::string, to_string, (), const,
                           [&x]() { return std::format("{}", x); }),
+     ANY_METHOD_DEFAULTED(model_file::scalar_t, to_scalar, (), const,
+                          [&x]() -> model_file::scalar_t {
+                            if constexpr (model_file::is_scalar<T>) {
+                              return model_file::to_scalar(x);
+                            } else {
+                              return std::format("{}", x);
+                            }
+                          }),
+     ANY_METHOD_DEFAULTED(std::optional<model_file::scalar_view_t>,
+                          to_scalar_view, (), const,
+                          [&x]() -> std::optional<model_file::scalar_view_t> {
+                            if constexpr (model_file::is_scalar<T>) {
+                              return model_file::to_scalar_view(x);
+                            } else {
+                              return {};
+                            }
+                          }),
+     ANY_METHOD_DEFAULTED(bool, append_to, (typed_column_t&), const,
+                          [&x](typed_column_t& column) {
+                            return column.append(x);
+                          }),
      ANY_METHOD_DEFAULTED(std::string, splits_op, (), const,
                           [&x]() {
                             if constexpr (std::same_as<T, bool>) {
@@ -90,6 +182,10 @@ ANY(sheet,
      ANY_METHOD(std::string, column_header, (std::size_t), const),
      ANY_METHOD_DEFAULTED(bool, column_is_significant, (std::size_t), const,
                           []([[maybe_unused]] auto) { return false; }),
+     ANY_METHOD_DEFAULTED(column_buffer_t, column_buffer, (std::size_t), const,
+                          []([[maybe_unused]] auto) {
+                            return column_buffer_t{};
+                          }),
      ANY_METHOD(std::size_t, column_count, (), const)),
     anyxx::const_observer, )
 
@@ -213,7 +309,7 @@ using observation_tuple_t = typename observation_tuple<Tuple>::type;
 
 using rows_t = std::vector<row<>>;
 using rows_set_t = std::set<row<>>;
-using result_counts_t = std::map<value<>, double>;
+using result_counts_t = std::pmr::map<value<>, double>;
 struct split_set {
   rows_t rows;
   anyxx::any_forward_range<row<>, row<>> operator()() const { return rows; }
@@ -246,8 +342,28 @@ struct column_value_t {
   value<> v;
 };
 
+// Nodes of trees built or pruned with a memory resource are allocated from
+// it, together with the leaf counts. Nodes made by std::make_unique are
+// deleted as usual.
+struct node_deleter {
+  std::pmr::memory_resource* resource = nullptr;
+
+  node_deleter() = default;
+  explicit node_deleter(std::pmr::memory_resource* node_resource)
+      : resource(node_resource) {}
+  node_deleter(std::default_delete<tree_t>) {}  // NOLINT
+
+  template <typename Node>
+  void operator()(Node* node) const {
+    if (resource)
+      std::pmr::polymorphic_allocator<Node>{resource}.delete_object(node);
+    else
+      delete node;
+  }
+};
+using node_ptr_t = std::unique_ptr<tree_t, node_deleter>;
 struct children_t {
-  std::unique_ptr<tree_t> true_path, false_path;
+  node_ptr_t true_path, false_path;
 };
 using node_data_t = std::variant<children_t, result_counts_t>;
 struct tree_t {
@@ -298,6 +414,13 @@ struct print_node {
   return s.str();
 }
 
+[[nodiscard]] inline node_ptr_t make_node(tree_t tree,
+                                          std::pmr::memory_resource* resource) {
+  std::pmr::polymorphic_allocator<tree_t> allocator{resource};
+  return node_ptr_t{allocator.new_object<tree_t>(std::move(tree)),
+                    node_deleter{resource}};
+}
+
 [[nodiscard]] inline split_sets_t split_table_by_column_value(
     std::size_t i, auto const& get_rows, value<> const& v) {
   split_sets_t split_sets;
@@ -343,36 +466,467 @@ struct print_node {
   return e;
 }
 
+// Training runs on dense class ids: the predict values are sorted into
+// classes_t once per build, and counts are plain arrays indexed by class id.
+// result_counts_t maps are only produced for the leaves.
+using class_id_t = std::uint32_t;
+using class_counts_t = std::pmr::vector<double>;
+
+struct classes_t {
+  std::vector<value<>> predict_values;
+
+  [[nodiscard]] class_id_t id(value<> const& predict_value) const {
+    return static_cast<class_id_t>(
+        std::lower_bound(predict_values.begin(), predict_values.end(),
+                         predict_value) -
+        predict_values.begin());
+  }
+  [[nodiscard]] class_counts_t empty_counts() const {
+    return class_counts_t(predict_values.size());
+  }
+  [[nodiscard]] result_counts_t to_result_counts(
+      class_counts_t const& counts,
+      std::pmr::memory_resource* resource =
+          std::pmr::get_default_resource()) const {
+    result_counts_t result_counts{resource};
+    for (std::size_t id = 0; id < counts.size(); ++id)
+      if (counts[id] > 0.0)
+        result_counts.emplace_hint(result_counts.end(), predict_values[id],
+                                   counts[id]);
+    return result_counts;
+  }
+};
+
+[[nodiscard]] inline classes_t encode_classes(sheet<> const& sheet_,
+                                              auto const& get_rows) {
+  std::set<value<>> predict_values;
+  for (auto const& row : get_rows())
+    predict_values.insert(get_predict_value(sheet_, row));
+  return {.predict_values = {predict_values.begin(), predict_values.end()}};
+}
+
+[[nodiscard]] inline class_counts_t class_counts(sheet<> const& sheet_,
+                                                 classes_t const& classes,
+                                                 auto const& get_rows) {
+  auto counts = classes.empty_counts();
+  for (auto const& row : get_rows())
+    ++counts[classes.id(get_predict_value(sheet_, row))];
+  return counts;
+}
+
+[[nodiscard]] inline double class_counts_total(class_counts_t const& counts) {
+  return std::accumulate(counts.begin(), counts.end(), 0.0);
+}
+
+[[nodiscard]] inline double class_gini_impurity(class_counts_t const& counts) {
+  double total = class_counts_total(counts);
+  auto impurity = 0.0;
+  for (std::size_t k1 = 0; k1 < counts.size(); ++k1)
+    for (std::size_t k2 = 0; k2 < counts.size(); ++k2)
+      if (k1 != k2 && counts[k1] > 0.0 && counts[k2] > 0.0)
+        impurity += (counts[k1] / total) * (counts[k2] / total);
+  return impurity;
+}
+
+[[nodiscard]] inline double class_entropy(class_counts_t const& counts) {
+  double total = class_counts_total(counts);
+  auto e = 0.0;
+  for (auto count : counts)
+    if (count > 0.0) {
+      auto p = count / total;
+      e -= p * std::log2(p);
+    }
+  return e;
+}
+
+// Score functions on result_counts_t still work for training, they get the
+// counts converted at every call.
+[[nodiscard]] inline auto class_score(auto score_function,
+                                      classes_t const& classes) {
+  if constexpr (std::invocable<decltype(score_function)&,
+                               class_counts_t const&>) {
+    return score_function;
+  } else {
+    return [score_function, &classes](class_counts_t const& counts) {
+      return score_function(classes.to_result_counts(counts));
+    };
+  }
+}
+
 struct gain_t {
   double gain;
   column_value_t criteria;
   split_sets_t split_sets;
+  // Candidates scored by the searches leading to this gain.
+  std::size_t candidates = 0;
+  // Index of the row criteria.v is taken from.
+  std::uint32_t threshold_row = 0;
 };
 
+namespace detail {
+
+enum class split_kind_t { greater_equal, equal, not_equal };
+
+// How value::take_true_path splits on candidate: numbers with >=, bools
+// with != and all others with ==. Boxed candidates split as their type
+// does, told apart by candidate itself and next, the next larger value.
+template <typename T>
+[[nodiscard]] split_kind_t split_kind(T const& candidate,
+                                      [[maybe_unused]] T const* next) {
+  if constexpr (std::same_as<T, value<>>) {
+    if (!candidate.take_true_path(candidate)) return split_kind_t::not_equal;
+    return next && next->take_true_path(candidate)
+               ? split_kind_t::greater_equal
+               : split_kind_t::equal;
+  } else if constexpr (std::same_as<T, bool>) {
+    return split_kind_t::not_equal;
+  } else if constexpr (std::is_arithmetic_v<T>) {
+    return split_kind_t::greater_equal;
+  } else {
+    return split_kind_t::equal;
+  }
+}
+
+}  // namespace detail
+
+// Scores every candidate of a column in one sweep over its value -> class
+// counts table, which must be ordered by ascending value. ">=" candidates
+// take their false counts from a running sum of the values below, "=="
+// and "!=" candidates their own counts, so a column costs linear time in
+// its distinct values. Candidates are visited in ascending order and
+// compared strictly, so ties resolve to the smallest value. counts_of
+// projects a table entry to its class counts, make_gain(gain, candidate,
+// entry, candidates) makes the gain_t of a better candidate.
+[[nodiscard]] inline gain_t find_best_gain_in_counts(
+    classes_t const& classes, auto const& counts_by_value, auto counts_of,
+    double row_count, gain_t best_gain, double current_score,
+    auto score_function, auto make_gain) {
+  auto total = classes.empty_counts();
+  for (auto const& entry : counts_by_value | std::views::values)
+    std::ranges::transform(total, counts_of(entry), total.begin(),
+                           std::plus<>{});
+  best_gain.candidates += counts_by_value.size();
+  auto below = classes.empty_counts();
+  auto true_counts = classes.empty_counts();
+  auto false_counts = classes.empty_counts();
+  for (auto it = counts_by_value.begin(); it != counts_by_value.end(); ++it) {
+    auto const& [candidate, entry] = *it;
+    class_counts_t const& counts = counts_of(entry);
+    auto const next = std::next(it);
+    switch (detail::split_kind(
+        candidate, next == counts_by_value.end() ? nullptr : &next->first)) {
+      case detail::split_kind_t::greater_equal:
+        std::ranges::transform(total, below, true_counts.begin(),
+                               std::minus<>{});
+        std::ranges::copy(below, false_counts.begin());
+        break;
+      case detail::split_kind_t::equal:
+        std::ranges::copy(counts, true_counts.begin());
+        std::ranges::transform(total, counts, false_counts.begin(),
+                               std::minus<>{});
+        break;
+      case detail::split_kind_t::not_equal:
+        std::ranges::transform(total, counts, true_counts.begin(),
+                               std::minus<>{});
+        std::ranges::copy(counts, false_counts.begin());
+        break;
+    }
+    std::ranges::transform(below, counts, below.begin(), std::plus<>{});
+    double true_count = class_counts_total(true_counts);
+    double p = true_count / row_count;
+    double possible_gain = current_score - p * score_function(true_counts) -
+                           (1 - p) * score_function(false_counts);
+    if (possible_gain > best_gain.gain && true_count > 0.0 &&
+        true_count < row_count)
+      best_gain =
+          make_gain(possible_gain, candidate, entry, best_gain.candidates);
+  }
+  return best_gain;
+}
+
+// One pass over the rows counts the classes per distinct value. Every
+// candidate is then scored from these counts, without touching the rows or
+// materializing its split. The counts are scratch data allocated from a
+// monotonic buffer that is released as a whole.
+[[nodiscard]] inline gain_t find_best_gain_in_column(
+    classes_t const& classes, sheet<> sheet_, auto const& get_rows,
+    std::size_t i, gain_t best_gain, double current_score,
+    auto score_function) {
+  std::pmr::monotonic_buffer_resource scratch;
+  std::pmr::map<value<>, class_counts_t> counts_by_value{&scratch};
+  auto row_count = 0.0;
+  for (auto const& row : get_rows()) {
+    auto [found, inserted] =
+        counts_by_value.try_emplace(row[i], classes.empty_counts());
+    ++found->second[classes.id(get_predict_value(sheet_, row))];
+    ++row_count;
+  }
+  return find_best_gain_in_counts(
+      classes, counts_by_value, std::identity{}, row_count,
+      std::move(best_gain), current_score, score_function,
+      [&](double gain, value<> const& candidate, class_counts_t const&,
+          std::size_t candidates) {
+        return gain_t{gain, {i, candidate}, {}, candidates};
+      });
+}
+
+[[nodiscard]] inline gain_t find_best_gain(classes_t const& classes,
+                                           sheet<> sheet_, auto const& get_rows,
+                                           gain_t best_gain,
+                                           double current_score,
+                                           auto score_function) {
+  for (auto i : std::views::iota(0u, sheet_.column_count() - 1))
+    best_gain = find_best_gain_in_column(classes, sheet_, get_rows, i,
+                                         std::move(best_gain), current_score,
+                                         score_function);
+  return best_gain;
+}
+
+// Evaluates the columns concurrently on the pool. The column winners are
+// reduced in column order with the same strict comparison as the sequential
+// search, so ties resolve identically.
+[[nodiscard]] inline gain_t find_best_gain(thread_pool& pool,
+                                           classes_t const& classes,
+                                           sheet<> sheet_, auto const& get_rows,
+                                           gain_t best_gain,
+                                           double current_score,
+                                           auto score_function) {
+  gain_t const start{.gain = best_gain.gain,
+                     .criteria = best_gain.criteria,
+                     .split_sets = {}};
+  std::vector<std::future<gain_t>> column_gains;
+  wait_guard const guard{pool, column_gains};
+  for (auto i : std::views::iota(0u, sheet_.column_count() - 1))
+    column_gains.push_back(pool.submit([&, i] {
+      return find_best_gain_in_column(classes, sheet_, get_rows, i, start,
+                                      current_score, score_function);
+    }));
+  auto candidates = best_gain.candidates;
+  for (auto& column_gain : column_gains) {
+    auto gain = pool.get(column_gain);
+    candidates += gain.candidates;
+    if (gain.gain > best_gain.gain) best_gain = std::move(gain);
+  }
+  best_gain.candidates = candidates;
+  return best_gain;
+}
+
 [[nodiscard]] inline gain_t find_best_gain(sheet<> sheet_, auto const& get_rows,
                                            gain_t best_gain,
                                            double current_score,
                                            auto score_function) {
-  for (auto i : std::views::iota(0u, sheet_.column_count() - 1)) {
-    std::set<value<>> column_values;
-    auto row_count = 0.0;
-    for (auto const& row : get_rows()) {
-      column_values.insert(row[i]);
-      ++row_count;
-    }
-    for (const auto& value : column_values) {
-      auto split_sets = split_table_by_column_value(i, get_rows, value);
-      double p = static_cast<double>(split_sets[0].rows.size()) / row_count;
-      double possible_gain =
-          current_score -
-          p * score_function(result_counts(sheet_, split_sets[0])) -
-          (1 - p) * score_function(result_counts(sheet_, split_sets[1]));
-      if (possible_gain > best_gain.gain && !split_sets[0].rows.empty() &&
-          !split_sets[1].rows.empty())
-        best_gain = {possible_gain, {i, value}, split_sets};
+  auto const classes = encode_classes(sheet_, get_rows);
+  best_gain = find_best_gain(classes, sheet_, get_rows, best_gain,
+                             current_score,
+                             class_score(score_function, classes));
+  if (best_gain.gain > 0.0)
+    best_gain.split_sets = split_table_by_column_value(
+        best_gain.criteria.column, get_rows, best_gain.criteria.v);
+  return best_gain;
+}
+
+// The training data of a build, read once: every row of get_rows is
+// visited once and every column of it read once. A column is then held
+// typed if the sheet hands it out as column buffer or all its values have
+// the same type of column_buffer_t, and boxed otherwise; the predict values
+// are held as dense class ids. Builds run on row indices into it only, so
+// sheets with slow accessors pay them once per build.
+struct training_set_t {
+  classes_t classes;
+  std::vector<class_id_t> class_ids;
+  // std::monostate for the boxed columns.
+  std::vector<column_buffer_t> columns;
+  std::vector<std::vector<value<>>> boxed;
+  std::vector<typed_column_t> typed;
+
+  [[nodiscard]] std::size_t size() const { return class_ids.size(); }
+  [[nodiscard]] value<> boxed_value(std::size_t column,
+                                    std::uint32_t row) const {
+    return std::visit(
+        [&]<typename Column>(Column const& values) -> value<> {
+          if constexpr (std::same_as<Column, std::monostate>)
+            return boxed[column][row];
+          else
+            return values[row];
+        },
+        columns[column]);
+  }
+};
+
+// The column buffers of sheet_ holding row_count rows, std::monostate for
+// the others.
+[[nodiscard]] inline std::vector<column_buffer_t> column_buffers(
+    sheet<> const& sheet_, std::size_t row_count) {
+  std::vector<column_buffer_t> columns;
+  for (std::size_t column = 0; column + 1 < sheet_.column_count(); ++column) {
+    auto buffer = sheet_.column_buffer(column);
+    auto const complete = std::visit(
+        [&]<typename Column>(Column const& values) {
+          if constexpr (std::same_as<Column, std::monostate>)
+            return false;
+          else
+            return values.size() == row_count;
+        },
+        buffer);
+    columns.push_back(complete ? buffer : column_buffer_t{});
+  }
+  return columns;
+}
+
+// Column buffers are used if get_rows are the rows of sheet_. Throws
+// std::length_error for more rows than 32 bit row indices hold.
+template <typename GetRows>
+[[nodiscard]] training_set_t materialize(sheet<> const& sheet_,
+                                         GetRows const& get_rows) {
+  rows_t rows;
+  for (auto const& row : get_rows()) rows.push_back(row);
+  if (rows.size() > std::numeric_limits<std::uint32_t>::max())
+    throw std::length_error("build_tree: too many rows");
+  training_set_t set;
+  std::vector<value<>> predict_values;
+  predict_values.reserve(rows.size());
+  for (auto const& row : rows)
+    predict_values.push_back(get_predict_value(sheet_, row));
+  std::set<value<>> const classes(predict_values.begin(),
+                                  predict_values.end());
+  set.classes.predict_values.assign(classes.begin(), classes.end());
+  set.class_ids.reserve(rows.size());
+  for (auto const& predict_value : predict_values)
+    set.class_ids.push_back(set.classes.id(predict_value));
+
+  auto const column_count = sheet_.column_count() - 1;
+  set.columns = std::vector<column_buffer_t>(column_count);
+  if constexpr (std::same_as<GetRows, sheet<>>)
+    if (&get_rows == &sheet_) set.columns = column_buffers(sheet_, rows.size());
+  set.boxed.resize(column_count);
+  for (std::size_t column = 0; column < column_count; ++column) {
+    if (set.columns[column].index() != 0) continue;
+    auto& boxed = set.boxed[column];
+    boxed.reserve(rows.size());
+    for (auto const& row : rows) boxed.push_back(row[column]);
+    typed_column_t typed{rows.size()};
+    if (std::ranges::all_of(boxed, [&](value<> const& v) {
+          return v.append_to(typed);
+        })) {
+      set.columns[column] = typed.buffer();
+      set.typed.push_back(std::move(typed));
+      boxed = {};
     }
   }
-  return best_gain;
+  return set;
+}
+
+// The rows of a node: a range of the single row index buffer of a build.
+// Once the split is known the range is partitioned stably in place, the
+// false rows pass through the same range of the build's scratch buffer.
+// Parallel subtrees therefore never share memory.
+struct indexed_rows {
+  training_set_t const* set = nullptr;
+  std::span<std::uint32_t> rows;
+  std::span<std::uint32_t> scratch;
+};
+
+namespace detail {
+
+// value::take_true_path on unboxed values.
+template <typename T>
+[[nodiscard]] bool take_true_path(T const& x, T const& threshold) {
+  if constexpr (std::same_as<T, value<>>)
+    return x.take_true_path(threshold);
+  else if constexpr (std::same_as<T, bool>)
+    return x != threshold;
+  else if constexpr (std::is_arithmetic_v<T>)
+    return x >= threshold;
+  else
+    return x == threshold;
+}
+
+}  // namespace detail
+
+[[nodiscard]] inline class_counts_t class_counts(
+    classes_t const& classes, indexed_rows const& node_rows) {
+  auto counts = classes.empty_counts();
+  for (auto row : node_rows.rows) ++counts[node_rows.set->class_ids[row]];
+  return counts;
+}
+
+// Calls f with the values of column, typed or boxed, indexed by row.
+[[nodiscard]] inline decltype(auto) visit_column(training_set_t const& set,
+                                                 std::size_t column,
+                                                 auto f) {
+  return std::visit(
+      [&]<typename Column>(Column const& values) {
+        if constexpr (std::same_as<Column, std::monostate>)
+          return f(std::span<value<> const>{set.boxed[column]});
+        else
+          return f(values);
+      },
+      set.columns[column]);
+}
+
+// find_best_gain_in_column on the values of column i. Every distinct value
+// remembers its first row, from which the threshold is boxed.
+[[nodiscard]] inline gain_t find_best_gain_in_column(
+    classes_t const& classes, sheet<>, indexed_rows const& node_rows,
+    std::size_t i, gain_t best_gain, double current_score,
+    auto score_function) {
+  auto const& set = *node_rows.set;
+  return visit_column(set, i, [&]<typename T>(std::span<T const> values) {
+    struct counted_t {
+      std::uint32_t first_row;
+      class_counts_t counts;
+    };
+    std::pmr::monotonic_buffer_resource scratch;
+    std::pmr::map<T, counted_t> counts_by_value{&scratch};
+    for (auto row : node_rows.rows) {
+      auto const& value = values[row];
+      auto found = counts_by_value.lower_bound(value);
+      if (found == counts_by_value.end() || value < found->first)
+        found = counts_by_value.emplace_hint(
+            found, value, counted_t{row, classes.empty_counts()});
+      ++found->second.counts[set.class_ids[row]];
+    }
+    return find_best_gain_in_counts(
+        classes, counts_by_value,
+        [](counted_t const& counted) -> class_counts_t const& {
+          return counted.counts;
+        },
+        static_cast<double>(node_rows.rows.size()), std::move(best_gain),
+        current_score, score_function,
+        [&](double gain, T const&, counted_t const& counted,
+            std::size_t candidates) {
+          return gain_t{gain,
+                        {i, set.boxed_value(i, counted.first_row)},
+                        {},
+                        candidates,
+                        counted.first_row};
+        });
+  });
+}
+
+[[nodiscard]] inline std::array<indexed_rows, 2> partition(
+    indexed_rows const& node_rows, column_value_t const& criteria,
+    std::uint32_t threshold_row) {
+  auto const& set = *node_rows.set;
+  return visit_column(
+      set, criteria.column, [&]<typename T>(std::span<T const> values) {
+        auto const& threshold = values[threshold_row];
+        std::size_t true_rows = 0, false_rows = 0;
+        for (auto row : node_rows.rows)
+          if (detail::take_true_path(values[row], threshold))
+            node_rows.rows[true_rows++] = row;
+          else
+            node_rows.scratch[false_rows++] = row;
+        std::ranges::copy(node_rows.scratch.first(false_rows),
+                          node_rows.rows.subspan(true_rows).begin());
+        return std::array{
+            indexed_rows{.set = &set,
+                         .rows = node_rows.rows.first(true_rows),
+                         .scratch = node_rows.scratch.first(true_rows)},
+            indexed_rows{.set = &set,
+                         .rows = node_rows.rows.subspan(true_rows),
+                         .scratch = node_rows.scratch.subspan(true_rows)}};
+      });
 }
 
 using analysed_columns_t = std::vector<std::size_t>;
@@ -392,50 +946,197 @@ find_first_untouched_significant_column(
   return analysed_columns;
 }
 
+// Reports node, with its partition time, to observer before building the
+// children.
+template <typename Observer>
 [[nodiscard]] inline tree_t build_tree_children(
-    sheet<> const& sheet_, auto score_function,
-    analysed_columns_t analysed_columns, gain_t gain) {
-  return tree_t{
-      .sheet_ = sheet_,
-      .column_value = gain.criteria,
-      .node_data = node_data_t{children_t{
-          .true_path = std::make_unique<tree_t>(
-              build_tree(sheet_, gain.split_sets[0], score_function,
-                         push_column(analysed_columns, gain.criteria.column))),
-          .false_path = std::make_unique<tree_t>(build_tree(
-              sheet_, gain.split_sets[1], score_function,
-              push_column(analysed_columns, gain.criteria.column)))}}};
+    classes_t const& classes, sheet<> const& sheet_, auto score_function,
+    analysed_columns_t analysed_columns, column_value_t const& criteria,
+    std::uint32_t threshold_row, indexed_rows const& node_rows,
+    parallel_build_t const* parallel, std::pmr::memory_resource* resource,
+    build_node_t node, Observer* observer) {
+  auto const partition_start = build_clock<Observer>::now();
+  auto const split_rows = partition(node_rows, criteria, threshold_row);
+  node.leaf = false;
+  node.partition_time = build_clock<Observer>::since(partition_start);
+  notify_build_node(observer, node);
+  auto build_path = [&](std::size_t path) {
+    return make_node(
+        build_tree(classes, sheet_, split_rows[path], score_function,
+                   push_column(analysed_columns, criteria.column), parallel,
+                   resource, observer, node.depth + 1),
+        resource);
+  };
+  if (parallel && node_rows.rows.size() >= parallel->subtrees_cutoff) {
+    auto true_path = parallel->pool.submit([&] { return build_path(0); });
+    wait_guard const guard{parallel->pool, true_path};
+    auto false_path = build_path(1);
+    return tree_t{.sheet_ = sheet_,
+                  .column_value = criteria,
+                  .node_data = node_data_t{
+                      children_t{.true_path = parallel->pool.get(true_path),
+                                 .false_path = std::move(false_path)}}};
+  }
+  return tree_t{.sheet_ = sheet_,
+                .column_value = criteria,
+                .node_data = node_data_t{
+                    children_t{.true_path = build_path(0),
+                               .false_path = build_path(1)}}};
 }  // NOLINT(clang-analyzer-cplusplus.NewDeleteLeaks)
 
+// Nodes and leaf counts are allocated from resource, which has to be thread
+// safe for parallel subtrees. Every node is reported to observer, see
+// build_observer.hpp.
+template <typename Observer = no_build_observer>
 [[nodiscard]] inline tree_t build_tree(
-    sheet<> const& sheet_, auto const& get_rows, auto score_function,
-    analysed_columns_t analysed_columns = {}) {
-  if (auto best_gain = find_best_gain(
-          sheet_, get_rows,
-          gain_t{.gain = 0.0, .criteria = {}, .split_sets = {}},
-          score_function(result_counts(sheet_, get_rows)), score_function);
-      best_gain.gain > 0.0)
-    return build_tree_children(sheet_, score_function, analysed_columns,
-                               best_gain);
-  auto rows = get_rows();
-  if (rows.begin() != rows.end())
+    classes_t const& classes, sheet<> const& sheet_,
+    indexed_rows const& node_rows, auto score_function,
+    analysed_columns_t analysed_columns, parallel_build_t const* parallel,
+    std::pmr::memory_resource* resource, Observer* observer = nullptr,
+    std::size_t depth = 0) {
+  auto const counts = class_counts(classes, node_rows);
+  auto const row_count = node_rows.rows.size();
+  gain_t const no_gain{.gain = 0.0, .criteria = {}, .split_sets = {}};
+  auto const search_start = build_clock<Observer>::now();
+  auto const best_gain =
+      parallel && row_count >= parallel->columns_cutoff
+          ? find_best_gain(parallel->pool, classes, sheet_, node_rows,
+                           no_gain, score_function(counts), score_function)
+          : find_best_gain(classes, sheet_, node_rows, no_gain,
+                           score_function(counts), score_function);
+  build_node_t const node{
+      .depth = depth,
+      .rows = row_count,
+      .candidates = best_gain.candidates,
+      .best_gain = best_gain.gain,
+      .leaf = true,
+      .search_time = build_clock<Observer>::since(search_start),
+      .partition_time = {}};
+  if (best_gain.gain > 0.0)
+    return build_tree_children(classes, sheet_, score_function,
+                               analysed_columns, best_gain.criteria,
+                               best_gain.threshold_row, node_rows, parallel,
+                               resource, node, observer);
+  if (!node_rows.rows.empty())
     if (auto column =
-            find_first_untouched_significant_column(sheet_, analysed_columns)) {
-      auto value = (*rows.begin())[*column];
-      return build_tree_children(sheet_, score_function, analysed_columns,
-                                 {.gain = 0.0,
-                                  .criteria = {.column = *column, .v = value},
-                                  .split_sets = split_table_by_column_value(
-                                      *column, get_rows, value)});
-    }
-
+            find_first_untouched_significant_column(sheet_, analysed_columns))
+      return build_tree_children(
+          classes, sheet_, score_function, analysed_columns,
+          {.column = *column,
+           .v = node_rows.set->boxed_value(*column, node_rows.rows.front())},
+          node_rows.rows.front(), node_rows, parallel, resource, node,
+          observer);
+
+  notify_build_node(observer, node);
   return tree_t{.sheet_ = sheet_,
                 .column_value = {},
-                .node_data = result_counts(sheet_, get_rows)};
+                .node_data = classes.to_result_counts(counts, resource)};
+}
+
+// Builds on set, see materialize. The nodes partition one buffer of its
+// row indices.
+template <typename Observer = no_build_observer>
+[[nodiscard]] inline tree_t build_tree(
+    training_set_t const& set, sheet<> const& sheet_, auto score_function,
+    analysed_columns_t analysed_columns,
+    parallel_build_t const* parallel = nullptr,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+    Observer* observer = nullptr) {
+  std::vector<std::uint32_t> rows(set.size());
+  std::iota(rows.begin(), rows.end(), std::uint32_t{0});
+  std::vector<std::uint32_t> scratch(set.size());
+  return build_tree(set.classes, sheet_,
+                    indexed_rows{.set = &set, .rows = rows, .scratch = scratch},
+                    score_function, std::move(analysed_columns), parallel,
+                    resource, observer);
+}
+
+[[nodiscard]] inline tree_t build_tree(
+    sheet<> const& sheet_, auto const& get_rows, auto score_function,
+    analysed_columns_t analysed_columns = {}) {
+  auto const set = materialize(sheet_, get_rows);
+  return build_tree(set, sheet_, class_score(score_function, set.classes),
+                    analysed_columns);
 }
 
 [[nodiscard]] inline tree_t build_tree(sheet<> const& sheet_) {
-  return build_tree(sheet_, sheet_, &entropy);
+  return build_tree(sheet_, sheet_, &class_entropy);
+}
+
+// Allocates the nodes and leaf counts of the tree from resource, e.g. a
+// monotonic arena that frees the whole model at once. resource has to
+// outlive the tree.
+[[nodiscard]] inline tree_t build_tree(std::pmr::memory_resource* resource,
+                                       sheet<> const& sheet_,
+                                       auto const& get_rows,
+                                       auto score_function) {
+  auto const set = materialize(sheet_, get_rows);
+  return build_tree(set, sheet_, class_score(score_function, set.classes), {},
+                    nullptr, resource);
+}
+
+[[nodiscard]] inline tree_t build_tree(std::pmr::memory_resource* resource,
+                                       sheet<> const& sheet_) {
+  return build_tree(resource, sheet_, sheet_, &class_entropy);
+}
+
+[[nodiscard]] inline tree_t build_tree(parallel_build_t const& parallel,
+                                       sheet<> const& sheet_,
+                                       auto const& get_rows,
+                                       auto score_function) {
+  auto const set = materialize(sheet_, get_rows);
+  return build_tree(set, sheet_, class_score(score_function, set.classes), {},
+                    &parallel);
+}
+
+// Searches the columns of every node in parallel on columns_pool.
+[[nodiscard]] inline tree_t build_tree(thread_pool& columns_pool,
+                                       sheet<> const& sheet_,
+                                       auto const& get_rows,
+                                       auto score_function) {
+  return build_tree(parallel_build_t{.pool = columns_pool}, sheet_, get_rows,
+                    score_function);
+}
+
+[[nodiscard]] inline tree_t build_tree(thread_pool& columns_pool,
+                                       sheet<> const& sheet_) {
+  return build_tree(columns_pool, sheet_, sheet_, &class_entropy);
+}
+
+// With parallel.subtrees_cutoff set, the subtrees of nodes with at least
+// that many rows are built as tasks on the pool, whose workers steal them
+// from each other.
+[[nodiscard]] inline tree_t build_tree(parallel_build_t const& parallel,
+                                       sheet<> const& sheet_) {
+  return build_tree(parallel, sheet_, sheet_, &class_entropy);
+}
+
+// Reports every node to observer, e.g. a build_statistics. The tree is the
+// one build_tree builds.
+template <build_observer Observer>
+[[nodiscard]] inline tree_t build_tree(Observer& observer,
+                                       sheet<> const& sheet_,
+                                       auto const& get_rows,
+                                       auto score_function) {
+  auto const set = materialize(sheet_, get_rows);
+  return build_tree(set, sheet_, class_score(score_function, set.classes), {},
+                    nullptr, std::pmr::get_default_resource(), &observer);
+}
+
+template <build_observer Observer>
+[[nodiscard]] inline tree_t build_tree(Observer& observer,
+                                       sheet<> const& sheet_) {
+  return build_tree(observer, sheet_, sheet_, &class_entropy);
+}
+
+// observer is called concurrently from the pool.
+template <build_observer Observer>
+[[nodiscard]] inline tree_t build_tree(Observer& observer,
+                                       parallel_build_t const& parallel,
+                                       sheet<> const& sheet_) {
+  auto const set = materialize(sheet_, sheet_);
+  return build_tree(set, sheet_, class_score(&class_entropy, set.classes), {},
+                    &parallel, std::pmr::get_default_resource(), &observer);
 }
 
 [[nodiscard]] inline result_counts_t classify(tree_t const& tree,
@@ -451,6 +1152,158 @@ find_first_untouched_significant_column(
     return classify(*children.false_path, probe);
 }
 
+// Model files, see model_file.hpp. The ops follow value::take_true_path:
+// bool splits with !=, arithmetic values with >=, all others with ==.
+// Values that are neither bool, arithmetic nor strings are stored as their
+// to_string, so they classify by that.
+[[nodiscard]] inline std::uint32_t to_model_node(
+    model_file::model_t& model, std::vector<result_counts_t const*>& leaves,
+    tree_t const& tree) {
+  if (auto result = std::get_if<result_counts_t>(&tree.node_data)) {
+    leaves.push_back(result);
+    return model_file::leaf_bit |
+           static_cast<std::uint32_t>(leaves.size() - 1);
+  }
+  auto const& children = std::get<children_t>(tree.node_data);
+  if (!children.true_path || !children.false_path) return model_file::leaf_bit;
+
+  auto const node = model.nodes.size();
+  auto threshold = tree.column_value.v.to_scalar();
+  auto const op = std::holds_alternative<bool>(threshold)
+                      ? model_file::op_t::not_equal
+                  : std::holds_alternative<std::string>(threshold)
+                      ? model_file::op_t::equal
+                      : model_file::op_t::greater_equal;
+  model.nodes.push_back(
+      {.column = static_cast<std::uint32_t>(tree.column_value.column),
+       .op = op,
+       .true_path = model_file::leaf_bit,
+       .false_path = model_file::leaf_bit,
+       .threshold = std::move(threshold)});
+  auto true_path = to_model_node(model, leaves, *children.true_path);
+  model.nodes[node].true_path = true_path;
+  auto false_path = to_model_node(model, leaves, *children.false_path);
+  model.nodes[node].false_path = false_path;
+  return static_cast<std::uint32_t>(node);
+}
+
+[[nodiscard]] inline model_file::model_t to_model(tree_t const& tree) {
+  model_file::model_t model;
+  result_counts_t const missing;
+  std::vector<result_counts_t const*> leaves{&missing};
+  model.root = to_model_node(model, leaves, tree);
+  std::set<value<>> predict_values;
+  for (auto const* leaf : leaves)
+    for (auto const& predict_value : *leaf | std::views::keys)
+      predict_values.insert(predict_value);
+  for (auto const& predict_value : predict_values)
+    model.predict_values.push_back(predict_value.to_scalar());
+  auto const class_count = predict_values.size();
+  model.leaf_count = leaves.size();
+  model.leaf_class_counts.resize(leaves.size() * class_count);
+  for (std::size_t leaf = 0; leaf < leaves.size(); ++leaf)
+    for (auto const& [predict_value, count] : *leaves[leaf])
+      model.leaf_class_counts[leaf * class_count +
+                              static_cast<std::size_t>(std::distance(
+                                  predict_values.begin(),
+                                  predict_values.find(predict_value)))] =
+          count;
+  return model;
+}
+
+// Writes tree as a header of nested ifs, see model_codegen.hpp.
+inline void generate_header(tree_t const& tree, std::ostream& os,
+                            std::string_view name_space) {
+  model_file::generate_header(to_model(tree), os, name_space);
+}
+
+[[nodiscard]] inline value<> from_scalar(model_file::scalar_view_t scalar) {
+  return std::visit(
+      []<typename S>(S const& v) -> value<> {
+        if constexpr (std::same_as<S, std::string_view>)
+          return std::string{v};
+        else
+          return v;
+      },
+      scalar);
+}
+
+[[nodiscard]] inline std::size_t classify_leaf(
+    model_file::model_view const& model, observation<> const& probe) {
+  std::string formatted;
+  return model.classify_leaf(
+      [&](std::size_t column) -> std::optional<model_file::scalar_view_t> {
+        auto query_value = probe[column];
+        if (!query_value) return {};
+        if (auto const scalar = query_value->to_scalar_view()) return scalar;
+        formatted = std::get<std::string>(query_value->to_scalar());
+        return formatted;
+      });
+}
+
+[[nodiscard]] inline result_counts_t classify(
+    model_file::model_view const& model, observation<> const& probe) {
+  auto const leaf = classify_leaf(model, probe);
+  result_counts_t result_counts;
+  for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id)
+    if (auto count = model.leaf_count(leaf, class_id); count > 0.0)
+      result_counts.emplace(from_scalar(model.predict_value(class_id)), count);
+  return result_counts;
+}
+
+// Lowers tree for serving without virtual calls, see lowered_tree.hpp.
+// schema holds the kind of every observation column.
+[[nodiscard]] inline lowered_tree_t lower(
+    tree_t const& tree, std::vector<model_file::tag_t> schema) {
+  return ml::lower(to_model(tree), std::move(schema));
+}
+
+// The cell of one column of probe, none if it is missing. Values of
+// scalar types are encoded through a view, without a copy.
+[[nodiscard]] inline lowered_tree_t::query_t encode(
+    lowered_tree_t const& tree, observation<> const& probe,
+    std::size_t column) {
+  auto const query_value = probe[column];
+  if (!query_value) return {};
+  if (auto const scalar = query_value->to_scalar_view())
+    return tree.encode(column, *scalar);
+  return tree.encode(column,
+                     model_file::to_scalar_view(query_value->to_scalar()));
+}
+
+// Reads every column of probe once; classify of tree then runs on the
+// cells.
+[[nodiscard]] inline std::vector<lowered_tree_t::query_t> encode(
+    lowered_tree_t const& tree, observation<> const& probe) {
+  std::vector<lowered_tree_t::query_t> query(tree.schema.size());
+  for (std::size_t column = 0; column < query.size(); ++column)
+    query[column] = encode(tree, probe, column);
+  return query;
+}
+
+// The dense counts of the leaf probe reaches, over tree.predict_values.
+// Encodes only the columns the walk tests and allocates neither a query
+// nor a result.
+[[nodiscard]] inline std::span<double const> classify_counts(
+    lowered_tree_t const& tree, observation<> const& probe) {
+  return tree.class_counts(tree.classify_leaf(
+      [&](std::size_t column) { return encode(tree, probe, column); }));
+}
+
+[[nodiscard]] inline result_counts_t classify(lowered_tree_t const& tree,
+                                              observation<> const& probe) {
+  auto const counts = classify_counts(tree, probe);
+  result_counts_t result_counts;
+  for (std::size_t class_id = 0; class_id < counts.size(); ++class_id) {
+    if (counts[class_id] <= 0.0) continue;
+    auto const& predict_value = tree.predict_values[class_id];
+    result_counts.emplace(
+        from_scalar(model_file::to_scalar_view(predict_value)),
+        counts[class_id]);
+  }
+  return result_counts;
+}
+
 [[nodiscard]] inline double sum(result_counts_t const& result_counts) {
   auto total = 0.0;
   for (auto const& [result, count] : result_counts) total += count;
@@ -462,11 +1315,23 @@ inline void add_weighted(result_counts_t& to, const result_counts_t& from,
   for (auto const& [result, count] : from) to[result] += count * weight;
 }
 
+// classify_with_missing_data passes every node it visits to a classify
+// logger. Loggers are taken by their type, so silent_logger and the other
+// typed ones are called directly and compile away if empty; logger<> erases
+// a logger chosen at run time.
+template <typename Logger>
+concept classify_logger =
+    requires(Logger& log, tree_t const& node, observation<> const& probe) {
+      log.node(node, probe);
+    };
+
+template <classify_logger Logger>
 [[nodiscard]] result_counts_t classify_with_missing_data(
-    tree_t const& tree, observation<> const& probe, logger<>& log);
+    tree_t const& tree, observation<> const& probe, Logger& log);
 
+template <classify_logger Logger>
 [[nodiscard]] inline result_counts_t combine_children_of_missing_data_node(
-    children_t const& children, observation<> const& probe, logger<>& log) {
+    children_t const& children, observation<> const& probe, Logger& log) {
   auto result_true =
       classify_with_missing_data(*children.true_path, probe, log);
   auto result_false =
@@ -480,8 +1345,9 @@ inline void add_weighted(result_counts_t& to, const result_counts_t& from,
   return combined_result_counts;
 }
 
+template <classify_logger Logger>
 [[nodiscard]] inline result_counts_t classify_with_missing_data(
-    tree_t const& tree, observation<> const& probe, logger<>& log) {
+    tree_t const& tree, observation<> const& probe, Logger& log) {
   log.node(tree, probe);
   if (auto result = std::get_if<result_counts_t>(&tree.node_data))
     return *result;
@@ -519,8 +1385,7 @@ struct stream_logger {
 [[nodiscard]] inline result_counts_t classify_with_missing_data(
     tree_t const& tree, observation<> const& probe) {
   silent_logger silent;
-  logger nolog{silent};
-  return classify_with_missing_data(tree, probe, nolog);
+  return classify_with_missing_data(tree, probe, silent);
 }
 
 [[nodiscard]] inline result_counts_t as_one(result_counts_t l,
@@ -542,25 +1407,31 @@ struct stream_logger {
   return score(pruned) - score_unpruned(true_result, false_result, score);
 }
 
-[[nodiscard]] inline children_t prune_children(tree_t const& tree,
-                                               double min_gain, auto score) {
+[[nodiscard]] inline children_t prune_children(
+    tree_t const& tree, double min_gain, auto score,
+    std::pmr::memory_resource* resource) {
   auto const& original_children = std::get<children_t>(tree.node_data);
-  return {.true_path = std::make_unique<tree_t>(
-              prune(*original_children.true_path, min_gain, score)),
-          .false_path = std::make_unique<tree_t>(
-              prune(*original_children.false_path, min_gain, score))};
+  return {
+      .true_path = make_node(
+          prune(*original_children.true_path, min_gain, score, resource),
+          resource),
+      .false_path = make_node(
+          prune(*original_children.false_path, min_gain, score, resource),
+          resource)};
 }
 
-[[nodiscard]] inline tree_t prune(tree_t const& tree, double min_gain,
-                                  auto score) {
+[[nodiscard]] inline tree_t prune(
+    tree_t const& tree, double min_gain, auto score,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
   if (std::holds_alternative<result_counts_t>(tree.node_data))
     return tree_t{.sheet_ = tree.sheet_,
                   .column_value = tree.column_value,
-                  .node_data = std::get<result_counts_t>(tree.node_data)};
+                  .node_data = result_counts_t{
+                      std::get<result_counts_t>(tree.node_data), resource}};
 
   tree_t pruned{.sheet_ = tree.sheet_,
                 .column_value = tree.column_value,
-                .node_data = prune_children(tree, min_gain, score)};
+                .node_data = prune_children(tree, min_gain, score, resource)};
   if (tree.sheet_.column_is_significant(pruned.column_value.column))
     return pruned;
 
@@ -569,9 +1440,10 @@ struct stream_logger {
           std::get_if<result_counts_t>(&pruned_children.true_path->node_data))
     if (auto false_result = std::get_if<result_counts_t>(
             &pruned_children.false_path->node_data))
-      if (auto pruned_result = as_one(*true_result, *false_result);
+      if (auto pruned_result =
+              as_one(result_counts_t{*true_result, resource}, *false_result);
           gain(pruned_result, *true_result, *false_result, score) < min_gain)
-        pruned.node_data = pruned_result;
+        pruned.node_data = std::move(pruned_result);
   return pruned;
 }
 
@@ -579,6 +1451,17 @@ struct stream_logger {
   return prune(tree, min_gain, &entropy);
 }
 
+[[nodiscard]] inline tree_t prune(std::pmr::memory_resource* resource,
+                                  tree_t const& tree, double min_gain,
+                                  auto score) {
+  return prune(tree, min_gain, score, resource);
+}
+
+[[nodiscard]] inline tree_t prune(std::pmr::memory_resource* resource,
+                                  tree_t const& tree, double min_gain) {
+  return prune(tree, min_gain, &entropy, resource);
+}
+
 }  // namespace bit_factory::ml::any_decision_tree
 
 // cppcheck-suppress-end unknownMacro
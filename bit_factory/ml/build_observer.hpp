@@ -0,0 +1,157 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace bit_factory::ml {
+
+// What the builders of decision_tree and any_decision_tree report about a
+// node, in depth first order, parents before their children.
+//
+// Allocated bytes are left out on purpose. A node is reported before its
+// own allocations, the boxes of its children or its leaf counts, are made,
+// and its column search allocates from scratch buffers that never reach
+// the build's memory_resource. Counting them per node would cost every
+// build an allocator wrapper. To measure the memory of a build, pass
+// build_tree a counting std::pmr::memory_resource.
+struct build_node_t {
+  std::size_t depth = 0;
+  std::size_t rows = 0;
+  // Split candidates scored, one per distinct value of every column
+  // searched and one per category set.
+  std::size_t candidates = 0;
+  // Gain of the chosen split, 0 for leaves.
+  double best_gain = 0.0;
+  bool leaf = true;
+  std::chrono::nanoseconds search_time{};
+  std::chrono::nanoseconds partition_time{};
+};
+
+// A training observer is passed to build_tree as first argument and gets
+// every node. Parallel builds call it concurrently.
+template <typename Observer>
+concept build_observer = requires(Observer& observer, build_node_t node) {
+  observer.node(node);
+};
+
+// The observer of the plain build_tree overloads. Builds with it neither
+// read the clock nor call anything.
+struct no_build_observer {
+  void node(build_node_t const&) {}
+};
+
+template <typename Observer>
+inline constexpr bool observes_build =
+    !std::same_as<Observer, no_build_observer>;
+
+template <typename Observer>
+struct build_clock {
+  using time_point = std::chrono::steady_clock::time_point;
+  [[nodiscard]] static time_point now() {
+    return std::chrono::steady_clock::now();
+  }
+  [[nodiscard]] static std::chrono::nanoseconds since(time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now() -
+                                                                start);
+  }
+};
+
+template <>
+struct build_clock<no_build_observer> {
+  struct time_point {};
+  [[nodiscard]] static time_point now() { return {}; }
+  [[nodiscard]] static std::chrono::nanoseconds since(time_point) {
+    return {};
+  }
+};
+
+template <typename Observer>
+void notify_build_node([[maybe_unused]] Observer* observer,
+                       [[maybe_unused]] build_node_t const& node) {
+  if constexpr (observes_build<Observer>) observer->node(node);
+}
+
+// Totals and a per depth histogram of the nodes of one or more builds.
+// Thread safe, so it may observe parallel builds.
+class build_statistics {
+ public:
+  struct level_t {
+    std::size_t nodes = 0;
+    std::size_t leaves = 0;
+    std::size_t rows = 0;
+    std::size_t candidates = 0;
+    std::chrono::nanoseconds search_time{};
+    std::chrono::nanoseconds partition_time{};
+
+    level_t& operator+=(level_t const& other) {
+      nodes += other.nodes;
+      leaves += other.leaves;
+      rows += other.rows;
+      candidates += other.candidates;
+      search_time += other.search_time;
+      partition_time += other.partition_time;
+      return *this;
+    }
+  };
+
+  void node(build_node_t const& node) {
+    std::scoped_lock lock{mutex_};
+    if (levels_.size() <= node.depth) levels_.resize(node.depth + 1);
+    levels_[node.depth] += {.nodes = 1,
+                            .leaves = node.leaf ? 1U : 0U,
+                            .rows = node.rows,
+                            .candidates = node.candidates,
+                            .search_time = node.search_time,
+                            .partition_time = node.partition_time};
+  }
+
+  // Index is the depth.
+  [[nodiscard]] std::vector<level_t> levels() const {
+    std::scoped_lock lock{mutex_};
+    return levels_;
+  }
+  [[nodiscard]] level_t totals() const {
+    level_t totals;
+    for (auto const& level : levels()) totals += level;
+    return totals;
+  }
+  void clear() {
+    std::scoped_lock lock{mutex_};
+    levels_.clear();
+  }
+
+  // One line per depth and one with the totals.
+  friend std::ostream& operator<<(std::ostream& os,
+                                  build_statistics const& statistics) {
+    auto line = [&](auto const& label, level_t const& level) {
+      using milliseconds = std::chrono::duration<double, std::milli>;
+      os << std::setw(6) << label << std::setw(10) << level.nodes
+         << std::setw(10) << level.leaves << std::setw(12) << level.rows
+         << std::setw(12) << level.candidates << std::setw(12)
+         << milliseconds(level.search_time).count() << std::setw(12)
+         << milliseconds(level.partition_time).count() << "\n";
+    };
+    os << std::setw(6) << "depth" << std::setw(10) << "nodes"
+       << std::setw(10) << "leaves" << std::setw(12) << "rows"
+       << std::setw(12) << "candidates" << std::setw(12) << "search ms"
+       << std::setw(12) << "partition ms" << "\n";
+    auto const levels = statistics.levels();
+    for (std::size_t depth = 0; depth < levels.size(); ++depth)
+      line(depth, levels[depth]);
+    level_t totals;
+    for (auto const& level : levels) totals += level;
+    line("total", totals);
+    return os;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<level_t> levels_;
+};
+
+}  // namespace bit_factory::ml
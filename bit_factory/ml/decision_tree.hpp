@@ -2,15 +2,29 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <bit_factory/ml/build_observer.hpp>
+#include <bit_factory/ml/model_codegen.hpp>
+#include <bit_factory/ml/model_file.hpp>
+#include <bit_factory/ml/thread_pool.hpp>
+#include <bitset>
 #include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <numeric>
 #include <optional>
 #include <ranges>
 #include <set>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -40,6 +54,14 @@ struct to_variant<std::tuple<Ts...>> {
   using type = std::variant<Ts...>;
 };
 
+template <typename Tuple>
+struct to_vectors;
+
+template <typename... Ts>
+struct to_vectors<std::tuple<Ts...>> {
+  using type = std::tuple<std::vector<Ts>...>;
+};
+
 template <class Tuple>
 struct remove_last;
 
@@ -60,8 +82,84 @@ struct remove_last<std::tuple<Args...>> {
       decltype(extract(std::make_index_sequence<sizeof...(Args) - 1>()));
 };
 
+// log2 for constant evaluation, where std::log2 is not constexpr. x has to
+// be positive and normal. Accurate to a few ulp.
+[[nodiscard]] constexpr double log2(double x) {
+  auto const bits = std::bit_cast<std::uint64_t>(x);
+  auto exponent = static_cast<int>((bits >> 52) & 0x7ff) - 1023;
+  auto mantissa = std::bit_cast<double>((bits & 0x000f'ffff'ffff'ffffULL) |
+                                        0x3ff0'0000'0000'0000ULL);
+  if (mantissa > 1.4142135623730951) {
+    mantissa /= 2;
+    ++exponent;
+  }
+  // ln(mantissa) = 2 atanh(z) with |z| < 0.172
+  auto const z = (mantissa - 1) / (mantissa + 1);
+  auto term = z, atanh = 0.0;
+  for (int k = 1; k < 40; k += 2) {
+    atanh += term / k;
+    term *= z * z;
+  }
+  return exponent + 2 * atanh * 1.4426950408889634;  // log2(e)
+}
+
 }  // namespace detail
 
+// Dense alternative to the observation_t of the sheets: the values of all
+// columns in one tuple or array, and a missing bit per column in 64 bit
+// words. Missing columns keep a default constructed value. Half the size of
+// a row of optionals, and complete observations are found by a test of the
+// words and walk compiled trees without missing checks, see
+// decision_tree::classify_leaf and classify_tile.
+template <typename Values>
+struct packed_observation {
+  using word_t = std::uint64_t;
+  static constexpr std::size_t size = std::tuple_size_v<Values>;
+  static constexpr std::size_t word_bits = 64;
+
+  Values values{};
+  std::array<word_t, (size + word_bits - 1) / word_bits> missing{};
+
+  // Packs a tuple or array of optionals, e.g. an observation_t.
+  template <typename Optionals>
+  [[nodiscard]] static constexpr packed_observation pack(
+      Optionals const& observation) {
+    packed_observation packed;
+    [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      (
+          [&] {
+            if (auto const& value = std::get<Columns>(observation))
+              std::get<Columns>(packed.values) = *value;
+            else
+              packed.set_missing(Columns);
+          }(),
+          ...);
+    }(std::make_index_sequence<size>{});
+    return packed;
+  }
+
+  [[nodiscard]] constexpr bool is_missing(std::size_t column) const {
+    return (missing[column / word_bits] >> (column % word_bits)) & 1U;
+  }
+  constexpr void set_missing(std::size_t column, bool is = true) {
+    auto const bit = word_t{1} << (column % word_bits);
+    if (is)
+      missing[column / word_bits] |= bit;
+    else
+      missing[column / word_bits] &= ~bit;
+  }
+  [[nodiscard]] constexpr bool complete() const {
+    return std::ranges::all_of(missing, [](word_t word) { return word == 0; });
+  }
+
+  template <std::size_t I>
+  [[nodiscard]] constexpr auto get() const
+      -> std::optional<std::tuple_element_t<I, Values>> {
+    if (is_missing(I)) return {};
+    return std::get<I>(values);
+  }
+};
+
 template <auto Labels, typename... Values>
 struct tulpe_sheet {
   // static_assert(
@@ -72,6 +170,8 @@ struct tulpe_sheet {
   using predict_t = std::tuple_element_t<predict_column, row_t>;
   using observation_t =
       typename detail::remove_last<std::tuple<std::optional<Values>...>>::type;
+  using packed_observation_t = packed_observation<
+      typename detail::remove_last<std::tuple<Values...>>::type>;
   using unique_tuple_t = typename detail::unique<std::tuple<>, Values...>::type;
   static constexpr const std::size_t observation_size = column_count - 1;
   template <std::size_t I>
@@ -80,15 +180,20 @@ struct tulpe_sheet {
   using observation_column_type = std::tuple_element_t<I, row_t>;
 
   template <std::size_t I>
-  static std::optional<row_column_type<I>> get_observation_value(
+  static constexpr std::optional<row_column_type<I>> get_observation_value(
       observation_t const& observation) {
     return std::get<I>(observation);
   }
   template <std::size_t I>
-  static auto get_observation_value(row_t const& row) {
+  static constexpr std::optional<row_column_type<I>> get_observation_value(
+      packed_observation_t const& observation) {
+    return observation.template get<I>();
+  }
+  template <std::size_t I>
+  static constexpr auto get_observation_value(row_t const& row) {
     return std::get<I>(row);
   }
-  static auto get_predict_value(row_t const& row) {
+  static constexpr auto get_predict_value(row_t const& row) {
     return std::get<column_count - 1>(row);
   }
 
@@ -100,6 +205,8 @@ template <typename ObservationValue, std::size_t ObservationSize,
 struct array_sheet {
   using observation_t =
       std::array<std::optional<ObservationValue>, ObservationSize>;
+  using packed_observation_t =
+      packed_observation<std::array<ObservationValue, ObservationSize>>;
   using predict_t = PredictValue;
   using row_t =
       std::pair<std::array<ObservationValue, ObservationSize>, PredictValue>;
@@ -112,15 +219,22 @@ struct array_sheet {
   using observation_column_type = ObservationValue;
 
   template <std::size_t I>
-  static std::optional<ObservationValue> get_observation_value(
+  static constexpr std::optional<ObservationValue> get_observation_value(
       observation_t const& observation) {
     return std::get<I>(observation);
   }
   template <std::size_t I>
-  static ObservationValue get_observation_value(row_t const& row) {
+  static constexpr std::optional<ObservationValue> get_observation_value(
+      packed_observation_t const& observation) {
+    return observation.template get<I>();
+  }
+  template <std::size_t I>
+  static constexpr ObservationValue get_observation_value(row_t const& row) {
     return std::get<I>(row.first);
   }
-  static predict_t get_predict_value(row_t const& row) { return row.second; }
+  static constexpr predict_t get_predict_value(row_t const& row) {
+    return row.second;
+  }
 
   static std::string get_label(std::size_t index) {
     if (index < observation_size) return "x[" + std::to_string(index) + "]";
@@ -128,6 +242,83 @@ struct array_sheet {
   }
 };
 
+// Columnar counterpart of tulpe_sheet: the table keeps every column in its
+// own vector, a row_t is only a reference to the table and a row index. A
+// column scan touches the bytes of that column and nothing else.
+template <auto Labels, typename... Values>
+struct column_sheet {
+  using columns_t = std::tuple<std::vector<Values>...>;
+  struct row_t {
+    columns_t const* columns = nullptr;
+    std::size_t index = 0;
+    friend auto operator<=>(row_t const&, row_t const&) = default;
+  };
+  inline static constexpr std::size_t column_count = sizeof...(Values);
+  inline static constexpr std::size_t predict_column = column_count - 1;
+  using predict_t = std::tuple_element_t<predict_column, std::tuple<Values...>>;
+  using observation_t =
+      typename detail::remove_last<std::tuple<std::optional<Values>...>>::type;
+  using packed_observation_t = packed_observation<
+      typename detail::remove_last<std::tuple<Values...>>::type>;
+  using unique_tuple_t = typename detail::unique<std::tuple<>, Values...>::type;
+  static constexpr const std::size_t observation_size = column_count - 1;
+  template <std::size_t I>
+  using row_column_type = std::tuple_element_t<I, std::tuple<Values...>>;
+  template <std::size_t I>
+  using observation_column_type = row_column_type<I>;
+
+  [[nodiscard]] static columns_t to_columns(
+      std::vector<std::tuple<Values...>> const& rows) {
+    columns_t columns;
+    [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      (std::get<Columns>(columns).reserve(rows.size()), ...);
+      for (auto const& row : rows)
+        (std::get<Columns>(columns).push_back(std::get<Columns>(row)), ...);
+    }(std::make_index_sequence<column_count>{});
+    return columns;
+  }
+  [[nodiscard]] static std::vector<row_t> rows(columns_t const& columns) {
+    std::vector<row_t> rows(std::get<0>(columns).size());
+    for (std::size_t index = 0; index < rows.size(); ++index)
+      rows[index] = {.columns = &columns, .index = index};
+    return rows;
+  }
+
+  template <std::size_t I>
+  static std::optional<row_column_type<I>> get_observation_value(
+      observation_t const& observation) {
+    return std::get<I>(observation);
+  }
+  template <std::size_t I>
+  static std::optional<row_column_type<I>> get_observation_value(
+      packed_observation_t const& observation) {
+    return observation.template get<I>();
+  }
+  template <std::size_t I>
+  static row_column_type<I> get_observation_value(row_t const& row) {
+    return std::get<I>(*row.columns)[row.index];
+  }
+  static predict_t get_predict_value(row_t const& row) {
+    return std::get<predict_column>(*row.columns)[row.index];
+  }
+
+  static std::string get_label(std::size_t index) { return Labels[index]; }
+};
+
+// What classify and classify_with_missing_data take: the observation_t of
+// Sheet or, if it has one, its packed_observation_t.
+template <typename Observation, typename Sheet>
+concept observation_of =
+    std::same_as<Observation, typename Sheet::observation_t> ||
+    std::same_as<Observation, typename Sheet::packed_observation_t>;
+
+// What the batch API takes: contiguous observations of Sheet, e.g. a
+// std::vector or std::span.
+template <typename Observations, typename Sheet>
+concept observations_of =
+    std::ranges::contiguous_range<Observations> &&
+    observation_of<std::ranges::range_value_t<Observations>, Sheet>;
+
 template <typename Sheet>
 struct decision_tree {
   // types
@@ -143,14 +334,16 @@ struct decision_tree {
   using observation_column_type =
       typename Sheet::template observation_column_type<I>;
   template <std::size_t I>
-  static auto get_observation_value(auto const& observation) {
+  static constexpr auto get_observation_value(auto const& observation) {
     return Sheet::template get_observation_value<I>(observation);
   }
 
   using rows_t = std::vector<row_t>;
   using rows_set_t = std::set<row_t>;
-  using result_counts_t = std::map<predict_t, double>;
+  using result_counts_t = std::pmr::map<predict_t, double>;
   using pointer_to_rows_t = std::vector<row_t const*>;
+  using row_range_t = std::span<row_t const*>;
+  using column_set_t = std::bitset<observation_size>;
   using split_sets_t = std::array<pointer_to_rows_t, 2>;
   using result_t = typename result_counts_t::value_type;
   using values_variant_t = typename detail::to_variant<unique_tuple_t>::type;
@@ -176,12 +369,26 @@ struct decision_tree {
     return s.str();
   }
 
+  // A node tests column against value, or, if value_set is not empty, for
+  // membership in value_set, which is sorted and holds categories of a
+  // non-arithmetic column (see build_tree_category_sets). value is then
+  // the first element of value_set.
   struct column_value_t {
     std::size_t column = {};
     values_variant_t value;
+    std::vector<values_variant_t> value_set = {};
     friend std::ostream& operator<<(std::ostream& os,
                                     column_value_t const& column_value) {
       os << Sheet::get_label(column_value.column);
+      if (!column_value.value_set.empty()) {
+        std::string separator;
+        os << " in {";
+        for (auto const& element : column_value.value_set)
+          std::visit(
+              [&](auto const& v) { os << std::exchange(separator, ", ") << v; },
+              element);
+        return os << "}?\n";
+      }
       std::visit(
           [&](const auto v) {
             os << std::boolalpha << decision_tree::splits_op(v) << v;
@@ -191,9 +398,29 @@ struct decision_tree {
     }
   };
 
+  // Nodes of trees built or pruned with a memory resource are allocated
+  // from it, together with the leaf counts. Nodes made by std::make_unique
+  // are deleted as usual.
   struct tree_t;
+  struct node_deleter {
+    std::pmr::memory_resource* resource = nullptr;
+
+    node_deleter() = default;
+    explicit node_deleter(std::pmr::memory_resource* node_resource)
+        : resource(node_resource) {}
+    node_deleter(std::default_delete<tree_t>) {}  // NOLINT
+
+    template <typename Node>
+    void operator()(Node* node) const {
+      if (resource)
+        std::pmr::polymorphic_allocator<Node>{resource}.delete_object(node);
+      else
+        delete node;
+    }
+  };
+  using node_ptr_t = std::unique_ptr<tree_t, node_deleter>;
   struct children_t {
-    std::unique_ptr<tree_t> true_path, false_path;
+    node_ptr_t true_path, false_path;
   };
   using node_data_t = std::variant<children_t, result_counts_t>;
   struct tree_t {
@@ -233,6 +460,13 @@ struct decision_tree {
     return s.str();
   }
 
+  [[nodiscard]] static node_ptr_t make_node(
+      tree_t tree, std::pmr::memory_resource* resource) {
+    std::pmr::polymorphic_allocator<tree_t> allocator{resource};
+    return node_ptr_t{allocator.template new_object<tree_t>(std::move(tree)),
+                      node_deleter{resource}};
+  }
+
   [[nodiscard]] static pointer_to_rows_t get_pointer_to_rows(
       rows_t const& rows) {
     pointer_to_rows_t pointer_to_rows;
@@ -260,6 +494,20 @@ struct decision_tree {
     }
   }
 
+  template <typename V>
+  [[nodiscard]] static constexpr bool splits(V const& query,
+                                             column_value_t const& criteria) {
+    if constexpr (!std::is_arithmetic_v<V>) {
+      if (!criteria.value_set.empty())
+        return std::ranges::binary_search(
+            criteria.value_set, query, std::less<>{},
+            [](values_variant_t const& element) -> V const& {
+              return std::get<V>(element);
+            });
+    }
+    return splits(query, std::get<V>(criteria.value));
+  }
+
   template <std::size_t I, typename V>
   [[nodiscard]] static split_sets_t split_table_by_column_value(
       pointer_to_rows_t const& rows, V const& value) {
@@ -308,67 +556,927 @@ struct decision_tree {
     return e;
   }
 
+  // Training runs on dense class ids: the predict values are sorted into
+  // classes_t once per build, and counts are plain arrays indexed by class
+  // id. result_counts_t maps are only produced for the leaves.
+  using class_id_t = std::uint32_t;
+  using class_counts_t = std::pmr::vector<double>;
+
+  struct classes_t {
+    std::vector<predict_t> predict_values;
+
+    [[nodiscard]] class_id_t id(predict_t const& predict_value) const {
+      return static_cast<class_id_t>(
+          std::ranges::lower_bound(predict_values, predict_value) -
+          predict_values.begin());
+    }
+    [[nodiscard]] class_counts_t empty_counts() const {
+      return class_counts_t(predict_values.size());
+    }
+    [[nodiscard]] result_counts_t to_result_counts(
+        std::span<double const> counts,
+        std::pmr::memory_resource* resource =
+            std::pmr::get_default_resource()) const {
+      result_counts_t result_counts{resource};
+      for (std::size_t id = 0; id < counts.size(); ++id)
+        if (counts[id] > 0.0)
+          result_counts.emplace_hint(result_counts.end(), predict_values[id],
+                                     counts[id]);
+      return result_counts;
+    }
+  };
+
+  [[nodiscard]] static classes_t encode_classes(auto const& rows,
+                                                auto get_predict_value) {
+    std::set<predict_t> predict_values;
+    for (auto const& row : rows) predict_values.insert(get_predict_value(row));
+    return {.predict_values = {predict_values.begin(), predict_values.end()}};
+  }
+
+  [[nodiscard]] static classes_t encode_classes(
+      pointer_to_rows_t const& rows) {
+    return encode_classes(
+        rows, [](row_t const* row) { return Sheet::get_predict_value(*row); });
+  }
+
+  [[nodiscard]] static class_counts_t class_counts(classes_t const& classes,
+                                                   auto const& rows,
+                                                   auto get_class_id) {
+    auto counts = classes.empty_counts();
+    for (auto const& row : rows) ++counts[get_class_id(row)];
+    return counts;
+  }
+
+  [[nodiscard]] static class_counts_t class_counts(
+      classes_t const& classes, std::span<row_t const* const> rows) {
+    return class_counts(classes, rows, [&](row_t const* row) {
+      return classes.id(Sheet::get_predict_value(*row));
+    });
+  }
+
+  [[nodiscard]] static constexpr double class_counts_total(
+      std::span<double const> counts) {
+    return std::ranges::fold_left(counts, 0.0, std::plus<double>{});
+  }
+
+  [[nodiscard]] static constexpr double class_gini_impurity(
+      std::span<double const> counts) {
+    double total = class_counts_total(counts);
+    auto impurity = 0.0;
+    for (std::size_t k1 = 0; k1 < counts.size(); ++k1)
+      for (std::size_t k2 = 0; k2 < counts.size(); ++k2)
+        if (k1 != k2 && counts[k1] > 0.0 && counts[k2] > 0.0)
+          impurity += (counts[k1] / total) * (counts[k2] / total);
+    return impurity;
+  }
+
+  [[nodiscard]] static constexpr double class_entropy(
+      std::span<double const> counts) {
+    double total = class_counts_total(counts);
+    auto e = 0.0;
+    for (auto count : counts)
+      if (count > 0.0) {
+        auto p = count / total;
+        if consteval {
+          e -= p * detail::log2(p);
+        } else {
+          e -= p * std::log2(p);
+        }
+      }
+    return e;
+  }
+
+  // Training scores spans of class counts. Score functions on
+  // class_counts_t or result_counts_t still work, they get the counts
+  // converted at every call.
+  [[nodiscard]] static auto class_score(auto score_function,
+                                        classes_t const& classes) {
+    if constexpr (std::invocable<decltype(score_function)&,
+                                 std::span<double const>>) {
+      return score_function;
+    } else if constexpr (std::invocable<decltype(score_function)&,
+                                        class_counts_t const&>) {
+      return [score_function](std::span<double const> counts) {
+        return score_function(class_counts_t(counts.begin(), counts.end()));
+      };
+    } else {
+      return [score_function, &classes](std::span<double const> counts) {
+        return score_function(classes.to_result_counts(counts));
+      };
+    }
+  }
+
   struct gain_t {
     double gain;
     column_value_t criteria;
     split_sets_t split_sets;
+    // Candidates scored by the searches leading to this gain.
+    std::size_t candidates = 0;
   };
 
+  // The value -> class counts tables of the column search are scratch data
+  // of one node; the search allocates them from a monotonic buffer that is
+  // released as a whole.
+  template <typename ColumnValue>
+  using column_counts_t = std::pmr::map<ColumnValue, class_counts_t>;
+
   template <std::size_t Column>
-  static gain_t find_best_gain(pointer_to_rows_t const& rows, gain_t best_gain,
-                               double current_score, auto score_function) {
+  [[nodiscard]] static column_counts_t<row_column_type<Column>> column_counts(
+      classes_t const& classes, std::span<row_t const* const> rows,
+      std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+    column_counts_t<row_column_type<Column>> counts{resource};
+    for (row_t const* row : rows) {
+      auto value = get_observation_value<Column>(*row);
+      auto found = counts.lower_bound(value);
+      if (found == counts.end() || counts.key_comp()(value, found->first))
+        found = counts.emplace_hint(found, std::move(value),
+                                    classes.empty_counts());
+      ++found->second[classes.id(Sheet::get_predict_value(*row))];
+    }
+    return counts;
+  }
+
+  template <std::size_t I = 0>
+  [[nodiscard]] static split_sets_t split_table_by_criteria(
+      pointer_to_rows_t const& rows, column_value_t const& criteria) {
+    if constexpr (I < observation_size) {
+      if (criteria.column != I)
+        return split_table_by_criteria<I + 1>(rows, criteria);
+      return split_table_by_column_value<I>(
+          rows, std::get<row_column_type<I>>(criteria.value));
+    } else {
+      return {};  // never reached
+    }
+  }
+
+  template <std::size_t I = 0>
+  [[nodiscard]] static constexpr bool row_takes_true_path(
+      row_t const& row, column_value_t const& criteria) {
+    if constexpr (I < observation_size) {
+      if (criteria.column != I)
+        return row_takes_true_path<I + 1>(row, criteria);
+      return splits(get_observation_value<I>(row), criteria);
+    } else {
+      return false;  // never reached
+    }
+  }
+
+  // The candidate sweep of one column, shared by build_tree and
+  // build_static_tree. counts_by_value holds (value, class counts) pairs
+  // ordered by ascending value and total their sum; below and complement
+  // are scratch of the class count. The ">=" candidates of arithmetic
+  // columns are scored with a running sum of the counts below the value,
+  // the "==" candidates directly. consider(value, gain) is called in
+  // ascending order for every candidate with rows on both sides.
+  template <typename ColumnValue>
+  static constexpr void sweep_column(auto const& counts_by_value,
+                                     std::span<double const> total,
+                                     std::span<double> below,
+                                     std::span<double> complement,
+                                     double row_count, double current_score,
+                                     auto score_function, auto consider) {
+    auto score = [&](ColumnValue const& value,
+                     std::span<double const> true_counts,
+                     std::span<double const> false_counts) {
+      double true_count = class_counts_total(true_counts);
+      double p = true_count / row_count;
+      double possible_gain = current_score - p * score_function(true_counts) -
+                             (1 - p) * score_function(false_counts);
+      if (true_count > 0.0 && true_count < row_count)
+        consider(value, possible_gain);
+    };
+    std::ranges::fill(below, 0.0);
+    for (auto const& [value, counts] : counts_by_value) {
+      if constexpr (std::is_arithmetic_v<ColumnValue> &&
+                    !std::same_as<ColumnValue, bool>) {
+        std::ranges::transform(total, below, complement.begin(),
+                               std::minus<>{});
+        score(value, complement, below);
+        std::ranges::transform(below, counts, below.begin(), std::plus<>{});
+      } else {
+        std::ranges::transform(total, counts, complement.begin(),
+                               std::minus<>{});
+        score(value, counts, complement);
+      }
+    }
+  }
+
+  // Evaluates every candidate of one column from its value -> class counts
+  // table, which must be ordered by ascending value. The ">=" candidates are
+  // scored with a running sum over the values, the "==" candidates directly
+  // from the table. Candidates are visited in ascending order, so ties
+  // resolve to the smallest value. With category_sets, non-arithmetic
+  // columns also get set candidates: the categories are ordered by their
+  // share of the node's most frequent class and every prefix of that order
+  // is scored as the true set. For two classes that order contains the
+  // best of all subsets (Breiman); a set only wins with a strictly larger
+  // gain than every "==" candidate.
+  template <std::size_t Column>
+  static gain_t find_best_gain_in_column(classes_t const& classes,
+                                         auto const& counts_by_value,
+                                         double row_count, gain_t best_gain,
+                                         double current_score,
+                                         auto score_function,
+                                         bool category_sets = false) {
+    using column_t = row_column_type<Column>;
+    auto total = classes.empty_counts();
+    for (auto const& counts : counts_by_value | std::views::values)
+      std::ranges::transform(total, counts, total.begin(), std::plus<>{});
+    best_gain.candidates += std::ranges::size(counts_by_value);
+    auto below = classes.empty_counts();
+    auto complement = classes.empty_counts();
+    sweep_column<column_t>(
+        counts_by_value, total, below, complement, row_count, current_score,
+        score_function, [&](column_t const& value, double possible_gain) {
+          if (possible_gain > best_gain.gain)
+            best_gain = {
+                possible_gain, {Column, value}, {}, best_gain.candidates};
+        });
+    if constexpr (!std::is_arithmetic_v<column_t>) {
+      if (category_sets && std::ranges::size(counts_by_value) > 3)
+        best_gain = find_best_category_set<Column>(
+            counts_by_value, total, row_count, std::move(best_gain),
+            current_score, score_function);
+    }
+    return best_gain;
+  }
+
+  template <std::size_t Column>
+  static gain_t find_best_category_set(auto const& counts_by_value,
+                                       std::span<double const> total,
+                                       double row_count, gain_t best_gain,
+                                       double current_score,
+                                       auto score_function) {
+    using column_t = row_column_type<Column>;
+    using category_counts_t =
+        std::pair<column_t const*, std::span<double const>>;
+    auto const majority = static_cast<std::size_t>(
+        std::ranges::max_element(total) - total.begin());
+    std::vector<category_counts_t> categories;
+    for (auto const& [value, counts] : counts_by_value)
+      categories.emplace_back(&value, counts);
+    std::ranges::stable_sort(categories, std::less<>{}, [&](auto const& c) {
+      return c.second[majority] / class_counts_total(c.second);
+    });
+
+    // Prefixes of one category, and their complements, are "==" candidates.
+    std::vector<double> in_set(total.size()), complement(total.size());
+    std::ranges::copy(categories.front().second, in_set.begin());
+    std::size_t best_size = 0;
+    for (std::size_t size = 2; size + 1 < categories.size(); ++size) {
+      std::ranges::transform(in_set, categories[size - 1].second,
+                             in_set.begin(), std::plus<>{});
+      std::ranges::transform(total, in_set, complement.begin(),
+                             std::minus<>{});
+      double true_count = class_counts_total(in_set);
+      double p = true_count / row_count;
+      double possible_gain = current_score - p * score_function(in_set) -
+                             (1 - p) * score_function(complement);
+      ++best_gain.candidates;
+      if (possible_gain > best_gain.gain) {
+        best_gain.gain = possible_gain;
+        best_size = size;
+      }
+    }
+    if (best_size > 0) {
+      std::vector<values_variant_t> value_set;
+      for (auto const& category : std::span{categories}.first(best_size))
+        value_set.emplace_back(std::in_place_type<column_t>, *category.first);
+      std::ranges::sort(value_set);
+      best_gain.criteria = {.column = Column,
+                            .value = value_set.front(),
+                            .value_set = std::move(value_set)};
+      best_gain.split_sets = {};
+    }
+    return best_gain;
+  }
+
+  // One pass over the rows per column. No split is materialized, the
+  // builder partitions the node's rows once the winner is known. Only the
+  // columns in columns are searched.
+  template <std::size_t Column>
+  static gain_t find_best_gain(classes_t const& classes,
+                               std::span<row_t const* const> rows,
+                               gain_t best_gain, double current_score,
+                               auto score_function,
+                               bool category_sets = false,
+                               column_set_t columns = ~column_set_t{}) {
     if constexpr (Column < observation_size) {
-      using column_t = row_column_type<Column>;
-      std::set<column_t> column_values;
-      for (auto const& row : rows)
-        column_values.insert(get_observation_value<Column>(*row));
-      for (const column_t& value : column_values) {
-        auto split_sets = split_table_by_column_value<Column>(rows, value);
-        double p = static_cast<double>(split_sets[0].size()) /
-                   static_cast<double>(rows.size());
-        double possible_gain =
-            current_score - p * score_function(result_counts(split_sets[0])) -
-            (1 - p) * score_function(result_counts(split_sets[1]));
-        if (possible_gain > best_gain.gain && !split_sets[0].empty() &&
-            !split_sets[1].empty())
-          best_gain = {possible_gain, {Column, value}, split_sets};
+      if (columns.test(Column)) {
+        std::pmr::monotonic_buffer_resource scratch;
+        best_gain = find_best_gain_in_column<Column>(
+            classes, column_counts<Column>(classes, rows, &scratch),
+            static_cast<double>(rows.size()), best_gain, current_score,
+            score_function, category_sets);
       }
-      return find_best_gain<Column + 1>(rows, best_gain, current_score,
-                                        score_function);
+      return find_best_gain<Column + 1>(classes, rows, std::move(best_gain),
+                                        current_score, score_function,
+                                        category_sets, columns);
     } else {
       return best_gain;
     }
   }
 
-  [[nodiscard]] static tree_t build_tree(pointer_to_rows_t const& rows,
+  // Evaluates the columns concurrently on the pool. The column winners are
+  // reduced in column order with the same strict comparison as the
+  // sequential search, so ties resolve identically.
+  static gain_t find_best_gain(thread_pool& pool, classes_t const& classes,
+                               std::span<row_t const* const> rows,
+                               gain_t best_gain, double current_score,
+                               auto score_function,
+                               bool category_sets = false,
+                               column_set_t columns = ~column_set_t{}) {
+    gain_t const start{.gain = best_gain.gain,
+                       .criteria = best_gain.criteria,
+                       .split_sets = {}};
+    auto column_gains = [&]<std::size_t... Columns>(
+                            std::index_sequence<Columns...>) {
+      return std::array{pool.submit([&] {
+        if (!columns.test(Columns)) return start;
+        std::pmr::monotonic_buffer_resource scratch;
+        return find_best_gain_in_column<Columns>(
+            classes, column_counts<Columns>(classes, rows, &scratch),
+            static_cast<double>(rows.size()), start, current_score,
+            score_function, category_sets);
+      })...};
+    }(std::make_index_sequence<observation_size>{});
+    wait_guard const guard{pool, column_gains};
+    auto candidates = best_gain.candidates;
+    for (auto& column_gain : column_gains) {
+      auto gain = pool.get(column_gain);
+      candidates += gain.candidates;
+      if (gain.gain > best_gain.gain) best_gain = std::move(gain);
+    }
+    best_gain.candidates = candidates;
+    return best_gain;
+  }
+
+  template <std::size_t Column>
+  static gain_t find_best_gain(pointer_to_rows_t const& rows, gain_t best_gain,
+                               double current_score, auto score_function) {
+    auto const classes = encode_classes(rows);
+    best_gain =
+        find_best_gain<Column>(classes, std::span{rows}, best_gain,
+                               current_score,
+                               class_score(score_function, classes));
+    if (best_gain.gain > 0.0)
+      best_gain.split_sets = split_table_by_criteria(rows, best_gain.criteria);
+    return best_gain;
+  }
+
+  // Moves the rows taking the true path to the front of the range and
+  // returns the two parts.
+  [[nodiscard]] static std::array<row_range_t, 2> partition(
+      row_range_t rows, column_value_t const& criteria) {
+    auto const true_rows = static_cast<std::size_t>(
+        std::partition(rows.begin(), rows.end(),
+                       [&](row_t const* row) {
+                         return row_takes_true_path(*row, criteria);
+                       }) -
+        rows.begin());
+    return {rows.first(true_rows), rows.subspan(true_rows)};
+  }
+
+  // The columns searched at every node of a build without a sampler.
+  struct all_columns {
+    [[nodiscard]] column_set_t operator()() const { return ~column_set_t{}; }
+  };
+
+  // A build works on a single buffer of row pointers. Every node owns a
+  // range of it, which is partitioned in place into the ranges of its
+  // children. Nodes and leaf counts are allocated from resource, which
+  // has to be thread safe for parallel subtrees. category_sets enables the
+  // set candidates of find_best_gain_in_column. Every node is reported to
+  // observer, see build_observer.hpp. If given, sample_columns is called
+  // once per node, in depth first order, for the columns to search there.
+  template <typename Observer = no_build_observer,
+            typename ColumnSampler = all_columns>
+  [[nodiscard]] static tree_t build_tree(
+      classes_t const& classes, row_range_t rows, auto score_function,
+      parallel_build_t const* parallel = nullptr,
+      std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+      bool category_sets = false, Observer* observer = nullptr,
+      ColumnSampler* sample_columns = nullptr, std::size_t depth = 0) {
+    if (rows.empty()) return {};
+    auto const counts = class_counts(classes, rows);
+    gain_t const no_gain{.gain = 0.0, .criteria = {}, .split_sets = {}};
+    auto const columns =
+        sample_columns ? (*sample_columns)() : ~column_set_t{};
+    auto const search_start = build_clock<Observer>::now();
+    auto const best_gain =
+        parallel && rows.size() >= parallel->columns_cutoff
+            ? find_best_gain(parallel->pool, classes, rows, no_gain,
+                             score_function(counts), score_function,
+                             category_sets, columns)
+            : find_best_gain<0>(classes, rows, no_gain,
+                                score_function(counts), score_function,
+                                category_sets, columns);
+    build_node_t node{.depth = depth,
+                      .rows = rows.size(),
+                      .candidates = best_gain.candidates,
+                      .best_gain = 0.0,
+                      .leaf = true,
+                      .search_time = build_clock<Observer>::since(search_start),
+                      .partition_time = {}};
+    if (best_gain.gain > 0.0) {
+      auto const partition_start = build_clock<Observer>::now();
+      auto const split_rows = partition(rows, best_gain.criteria);
+      node.best_gain = best_gain.gain;
+      node.leaf = false;
+      node.partition_time = build_clock<Observer>::since(partition_start);
+      notify_build_node(observer, node);
+      auto build_path = [&](std::size_t path) {
+        return make_node(build_tree(classes, split_rows[path], score_function,
+                                    parallel, resource, category_sets,
+                                    observer, sample_columns, depth + 1),
+                         resource);
+      };
+      if (parallel && rows.size() >= parallel->subtrees_cutoff) {
+        auto true_path = parallel->pool.submit([&] { return build_path(0); });
+        wait_guard const guard{parallel->pool, true_path};
+        auto false_path = build_path(1);
+        return tree_t{.column_value = best_gain.criteria,
+                      .node_data = node_data_t{children_t{
+                          .true_path = parallel->pool.get(true_path),
+                          .false_path = std::move(false_path)}}};
+      }
+      return tree_t{.column_value = best_gain.criteria,
+                    .node_data = node_data_t{
+                        children_t{.true_path = build_path(0),
+                                   .false_path = build_path(1)}}};
+    }
+    notify_build_node(observer, node);
+    return tree_t{.column_value = {},
+                  .node_data = classes.to_result_counts(counts, resource)};
+  }  // NOLINT(clang-analyzer-cplusplus.NewDeleteLeaks)
+
+  [[nodiscard]] static tree_t build_tree(pointer_to_rows_t rows,
+                                         auto score_function) {
+    auto const classes = encode_classes(rows);
+    return build_tree(classes, row_range_t{rows},
+                      class_score(score_function, classes));
+  }
+
+  // Allocates the nodes and leaf counts of the tree from resource, e.g. a
+  // monotonic arena that frees the whole model at once. resource has to
+  // outlive the tree.
+  [[nodiscard]] static tree_t build_tree(std::pmr::memory_resource* resource,
+                                         rows_t const& rows,
+                                         auto score_function) {
+    auto pointer_to_rows = get_pointer_to_rows(rows);
+    auto const classes = encode_classes(pointer_to_rows);
+    return build_tree(classes, row_range_t{pointer_to_rows},
+                      class_score(score_function, classes), nullptr,
+                      resource);
+  }
+  [[nodiscard]] static tree_t build_tree(std::pmr::memory_resource* resource,
+                                         rows_t const& rows) {
+    return build_tree(resource, rows, &class_entropy);
+  }
+
+  [[nodiscard]] static tree_t build_tree(rows_t const& rows,
+                                         auto score_function) {
+    return build_tree(get_pointer_to_rows(rows), score_function);
+  }
+  [[nodiscard]] static tree_t build_tree(rows_t const& rows) {
+    return build_tree(rows, &class_entropy);
+  }
+
+  [[nodiscard]] static tree_t build_tree(parallel_build_t const& parallel,
+                                         rows_t const& rows,
                                          auto score_function) {
+    auto pointer_to_rows = get_pointer_to_rows(rows);
+    auto const classes = encode_classes(pointer_to_rows);
+    return build_tree(classes, row_range_t{pointer_to_rows},
+                      class_score(score_function, classes), &parallel);
+  }
+  [[nodiscard]] static tree_t build_tree(parallel_build_t const& parallel,
+                                         rows_t const& rows) {
+    return build_tree(parallel, rows, &class_entropy);
+  }
+
+  // Searches the columns of every node in parallel on columns_pool.
+  [[nodiscard]] static tree_t build_tree(thread_pool& columns_pool,
+                                         rows_t const& rows,
+                                         auto score_function) {
+    return build_tree(parallel_build_t{.pool = columns_pool}, rows,
+                      score_function);
+  }
+  [[nodiscard]] static tree_t build_tree(thread_pool& columns_pool,
+                                         rows_t const& rows) {
+    return build_tree(columns_pool, rows, &class_entropy);
+  }
+
+  // Builds the subtrees of nodes with at least subtrees_cutoff rows as tasks
+  // on the pool, whose workers steal them from each other. These nodes also
+  // search their columns in parallel; smaller nodes are built sequentially.
+  [[nodiscard]] static tree_t build_tree(thread_pool& pool,
+                                         std::size_t subtrees_cutoff,
+                                         rows_t const& rows,
+                                         auto score_function) {
+    return build_tree(parallel_build_t{.pool = pool,
+                                       .columns_cutoff = subtrees_cutoff,
+                                       .subtrees_cutoff = subtrees_cutoff},
+                      rows, score_function);
+  }
+  [[nodiscard]] static tree_t build_tree(thread_pool& pool,
+                                         std::size_t subtrees_cutoff,
+                                         rows_t const& rows) {
+    return build_tree(pool, subtrees_cutoff, rows, &class_entropy);
+  }
+
+  // Reports every node to observer, e.g. a build_statistics. The tree is the
+  // one build_tree builds.
+  template <build_observer Observer>
+  [[nodiscard]] static tree_t build_tree(Observer& observer,
+                                         rows_t const& rows,
+                                         auto score_function) {
+    auto pointer_to_rows = get_pointer_to_rows(rows);
+    auto const classes = encode_classes(pointer_to_rows);
+    return build_tree(classes, row_range_t{pointer_to_rows},
+                      class_score(score_function, classes), nullptr,
+                      std::pmr::get_default_resource(), false, &observer);
+  }
+  template <build_observer Observer>
+  [[nodiscard]] static tree_t build_tree(Observer& observer,
+                                         rows_t const& rows) {
+    return build_tree(observer, rows, &class_entropy);
+  }
+  // observer is called concurrently from the pool.
+  template <build_observer Observer>
+  [[nodiscard]] static tree_t build_tree(Observer& observer,
+                                         parallel_build_t const& parallel,
+                                         rows_t const& rows,
+                                         auto score_function) {
+    auto pointer_to_rows = get_pointer_to_rows(rows);
+    auto const classes = encode_classes(pointer_to_rows);
+    return build_tree(classes, row_range_t{pointer_to_rows},
+                      class_score(score_function, classes), &parallel,
+                      std::pmr::get_default_resource(), false, &observer);
+  }
+  template <build_observer Observer>
+  [[nodiscard]] static tree_t build_tree(Observer& observer,
+                                         parallel_build_t const& parallel,
+                                         rows_t const& rows) {
+    return build_tree(observer, parallel, rows, &class_entropy);
+  }
+
+  // Lets non-arithmetic columns also split into two sets of categories,
+  // "column in {a, b, c}?", instead of chains of "==" splits. Shallower
+  // trees for columns with many categories; the other columns split as in
+  // build_tree. Model files and static trees do not support set splits.
+  [[nodiscard]] static tree_t build_tree_category_sets(rows_t const& rows,
+                                                       auto score_function) {
+    auto pointer_to_rows = get_pointer_to_rows(rows);
+    auto const classes = encode_classes(pointer_to_rows);
+    return build_tree(classes, row_range_t{pointer_to_rows},
+                      class_score(score_function, classes), nullptr,
+                      std::pmr::get_default_resource(), true);
+  }
+  [[nodiscard]] static tree_t build_tree_category_sets(rows_t const& rows) {
+    return build_tree_category_sets(rows, &class_entropy);
+  }
+
+  // SLIQ/SPRINT style training: every column is sorted once into a list of
+  // row indices at the root. A node owns the same range of every list, the
+  // ranges are partitioned stably in place down the recursion, so no node
+  // has to sort or look up column values again.
+  using row_indices_t = std::vector<std::size_t>;
+  using attribute_lists_t = std::array<row_indices_t, observation_size>;
+  using attribute_ranges_t =
+      std::array<std::span<std::size_t>, observation_size>;
+
+  struct presorted_rows_t {
+    rows_t const& rows;
+    classes_t classes;
+    std::vector<class_id_t> class_ids;
+    std::vector<bool> takes_true_path = std::vector<bool>(rows.size());
+    row_indices_t false_rows = row_indices_t(rows.size());
+  };
+
+  [[nodiscard]] static presorted_rows_t encode_presorted_rows(
+      rows_t const& rows) {
+    presorted_rows_t presorted{
+        .rows = rows,
+        .classes = encode_classes(
+            rows, [](row_t const& row) { return Sheet::get_predict_value(row); }),
+        .class_ids = {}};
+    presorted.class_ids.reserve(rows.size());
+    for (auto const& row : rows)
+      presorted.class_ids.push_back(
+          presorted.classes.id(Sheet::get_predict_value(row)));
+    return presorted;
+  }
+
+  [[nodiscard]] static attribute_lists_t presort(rows_t const& rows) {
+    attribute_lists_t attribute_lists;
+    [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      (
+          [&] {
+            auto& attribute_list = attribute_lists[Columns];
+            attribute_list.resize(rows.size());
+            std::iota(attribute_list.begin(), attribute_list.end(),
+                      std::size_t{0});
+            std::ranges::stable_sort(
+                attribute_list, [&](std::size_t l, std::size_t r) {
+                  return get_observation_value<Columns>(rows[l]) <
+                         get_observation_value<Columns>(rows[r]);
+                });
+          }(),
+          ...);
+    }(std::make_index_sequence<observation_size>{});
+    return attribute_lists;
+  }
+
+  template <std::size_t Column>
+  [[nodiscard]] static auto sorted_column_counts(
+      presorted_rows_t const& presorted,
+      std::span<std::size_t const> attribute_list) {
+    std::vector<std::pair<row_column_type<Column>, class_counts_t>> counts;
+    for (auto i : attribute_list) {
+      auto value = get_observation_value<Column>(presorted.rows[i]);
+      if (counts.empty() || counts.back().first < value)
+        counts.emplace_back(std::move(value), presorted.classes.empty_counts());
+      ++counts.back().second[presorted.class_ids[i]];
+    }
+    return counts;
+  }
+
+  template <std::size_t Column>
+  static gain_t find_best_gain(presorted_rows_t const& presorted,
+                               attribute_ranges_t const& attribute_lists,
+                               gain_t best_gain, double current_score,
+                               auto score_function) {
+    if constexpr (Column < observation_size) {
+      return find_best_gain<Column + 1>(
+          presorted, attribute_lists,
+          find_best_gain_in_column<Column>(
+              presorted.classes,
+              sorted_column_counts<Column>(presorted, attribute_lists[Column]),
+              static_cast<double>(attribute_lists[Column].size()), best_gain,
+              current_score, score_function),
+          current_score, score_function);
+    } else {
+      return best_gain;
+    }
+  }
+
+  // The true rows of every list are compacted to the front of its range,
+  // the false rows go through the false_rows buffer to the back.
+  [[nodiscard]] static std::array<attribute_ranges_t, 2> partition(
+      presorted_rows_t& presorted, attribute_ranges_t const& attribute_lists,
+      column_value_t const& criteria) {
+    for (auto i : attribute_lists[criteria.column])
+      presorted.takes_true_path[i] =
+          row_takes_true_path(presorted.rows[i], criteria);
+    std::array<attribute_ranges_t, 2> split_lists;
+    for (std::size_t column = 0; column < observation_size; ++column) {
+      auto const attribute_list = attribute_lists[column];
+      std::size_t true_rows = 0, false_rows = 0;
+      for (auto i : attribute_list)
+        if (presorted.takes_true_path[i])
+          attribute_list[true_rows++] = i;
+        else
+          presorted.false_rows[false_rows++] = i;
+      std::ranges::copy(std::span{presorted.false_rows}.first(false_rows),
+                        attribute_list.begin() + static_cast<std::ptrdiff_t>(
+                                                     true_rows));
+      split_lists[0][column] = attribute_list.first(true_rows);
+      split_lists[1][column] = attribute_list.subspan(true_rows);
+    }
+    return split_lists;
+  }
+
+  [[nodiscard]] static tree_t build_tree(
+      presorted_rows_t& presorted, attribute_ranges_t const& attribute_lists,
+      auto score_function) {
+    auto const& rows = attribute_lists[0];
     if (rows.empty()) return {};
+    auto const counts = class_counts(
+        presorted.classes, rows,
+        [&](std::size_t i) { return presorted.class_ids[i]; });
     if (auto best_gain = find_best_gain<0>(
-            rows, gain_t{.gain = 0.0, .criteria = {}, .split_sets = {}},
-            score_function(result_counts(rows)), score_function);
+            presorted, attribute_lists,
+            gain_t{.gain = 0.0, .criteria = {}, .split_sets = {}},
+            score_function(counts), score_function);
         best_gain.gain > 0.0) {
+      auto const split_lists =
+          partition(presorted, attribute_lists, best_gain.criteria);
       return tree_t{.column_value = best_gain.criteria,
                     .node_data = node_data_t{children_t{
                         .true_path = std::make_unique<tree_t>(build_tree(
-                            best_gain.split_sets[0], score_function)),
+                            presorted, split_lists[0], score_function)),
                         .false_path = std::make_unique<tree_t>(build_tree(
-                            best_gain.split_sets[1], score_function))}}};
+                            presorted, split_lists[1], score_function))}}};
     } else
-      return tree_t{.column_value = {}, .node_data = result_counts(rows)};
+      return tree_t{.column_value = {},
+                    .node_data = presorted.classes.to_result_counts(counts)};
   }  // NOLINT(clang-analyzer-cplusplus.NewDeleteLeaks)
 
-  [[nodiscard]] static tree_t build_tree(rows_t const& rows,
+  [[nodiscard]] static tree_t build_tree_presorted(rows_t const& rows,
+                                                   auto score_function) {
+    auto presorted = encode_presorted_rows(rows);
+    auto attribute_lists = presort(rows);
+    attribute_ranges_t attribute_ranges;
+    std::ranges::copy(attribute_lists, attribute_ranges.begin());
+    return build_tree(presorted, attribute_ranges,
+                      class_score(score_function, presorted.classes));
+  }
+  [[nodiscard]] static tree_t build_tree_presorted(rows_t const& rows) {
+    return build_tree_presorted(rows, &class_entropy);
+  }
+
+  // Histogram training: every column is encoded once into bin ids. A numeric
+  // column with more than max_bins distinct values gets max_bins quantile
+  // bins, each represented by its smallest value, which becomes the ">="
+  // threshold; all other columns get one bin per distinct value. Nodes count
+  // the classes per bin, and the larger child takes its histogram as parent
+  // minus sibling. With max_bins at least the number of distinct values the
+  // trees equal the ones of build_tree.
+  using bin_t = std::uint32_t;
+  using histogram_t = std::vector<double>;
+
+  template <std::size_t... Columns>
+  static auto make_bin_values(std::index_sequence<Columns...>)
+      -> std::tuple<std::vector<row_column_type<Columns>>...>;
+  using bin_values_t =
+      decltype(make_bin_values(std::make_index_sequence<observation_size>{}));
+
+  struct binned_rows_t {
+    rows_t const& rows;
+    classes_t classes;
+    std::vector<class_id_t> class_ids;
+    bin_values_t bin_values;
+    std::array<std::vector<bin_t>, observation_size> bins;
+    std::array<std::size_t, observation_size> histogram_offsets;
+    std::size_t histogram_size = 0;
+  };
+
+  template <std::size_t Column>
+  static void bin_column(binned_rows_t& binned, std::size_t max_bins) {
+    using column_t = row_column_type<Column>;
+    std::vector<column_t> values;
+    values.reserve(binned.rows.size());
+    for (auto const& row : binned.rows)
+      values.push_back(get_observation_value<Column>(row));
+    std::sort(values.begin(), values.end());
+    auto& bin_values = std::get<Column>(binned.bin_values);
+    std::ranges::unique_copy(values, std::back_inserter(bin_values));
+    if constexpr (std::is_arithmetic_v<column_t> &&
+                  !std::same_as<column_t, bool>) {
+      if (bin_values.size() > max_bins) {
+        bin_values.clear();
+        for (std::size_t bin = 0; bin < max_bins; ++bin)
+          if (auto const& value = values[bin * values.size() / max_bins];
+              bin_values.empty() || bin_values.back() < value)
+            bin_values.push_back(value);
+      }
+    }
+    auto& bins = binned.bins[Column];
+    bins.reserve(binned.rows.size());
+    for (auto const& row : binned.rows)
+      bins.push_back(static_cast<bin_t>(
+          std::ranges::upper_bound(bin_values,
+                                   get_observation_value<Column>(row)) -
+          bin_values.begin() - 1));
+  }
+
+  [[nodiscard]] static binned_rows_t encode_binned_rows(rows_t const& rows,
+                                                        std::size_t max_bins) {
+    if (max_bins == 0)
+      throw std::invalid_argument("build_tree_binned: max_bins is 0");
+    binned_rows_t binned{
+        .rows = rows,
+        .classes = encode_classes(
+            rows, [](row_t const& row) { return Sheet::get_predict_value(row); }),
+        .class_ids = {},
+        .bin_values = {},
+        .bins = {},
+        .histogram_offsets = {}};
+    binned.class_ids.reserve(rows.size());
+    for (auto const& row : rows)
+      binned.class_ids.push_back(
+          binned.classes.id(Sheet::get_predict_value(row)));
+    [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      (
+          [&] {
+            bin_column<Columns>(binned, max_bins);
+            binned.histogram_offsets[Columns] = binned.histogram_size;
+            binned.histogram_size +=
+                std::get<Columns>(binned.bin_values).size() *
+                binned.classes.predict_values.size();
+          }(),
+          ...);
+    }(std::make_index_sequence<observation_size>{});
+    return binned;
+  }
+
+  [[nodiscard]] static histogram_t histogram(
+      binned_rows_t const& binned, std::span<std::size_t const> rows) {
+    auto const class_count = binned.classes.predict_values.size();
+    histogram_t histogram(binned.histogram_size);
+    for (std::size_t column = 0; column < observation_size; ++column) {
+      auto const offset = binned.histogram_offsets[column];
+      auto const& bins = binned.bins[column];
+      for (auto i : rows)
+        ++histogram[offset + bins[i] * class_count + binned.class_ids[i]];
+    }
+    return histogram;
+  }
+
+  template <std::size_t Column>
+  static gain_t find_best_gain(binned_rows_t const& binned,
+                               histogram_t const& histogram, double row_count,
+                               gain_t best_gain, double current_score,
+                               auto score_function) {
+    if constexpr (Column < observation_size) {
+      using column_t = row_column_type<Column>;
+      auto const& bin_values = std::get<Column>(binned.bin_values);
+      auto const class_count = binned.classes.predict_values.size();
+      std::vector<std::pair<typename std::vector<column_t>::const_reference,
+                            std::span<double const>>>
+          counts_by_value;
+      counts_by_value.reserve(bin_values.size());
+      for (std::size_t bin = 0; bin < bin_values.size(); ++bin)
+        if (auto counts = std::span{histogram}.subspan(
+                binned.histogram_offsets[Column] + bin * class_count,
+                class_count);
+            class_counts_total(counts) > 0.0)
+          counts_by_value.emplace_back(bin_values[bin], counts);
+      return find_best_gain<Column + 1>(
+          binned, histogram, row_count,
+          find_best_gain_in_column<Column>(binned.classes, counts_by_value,
+                                           row_count, best_gain, current_score,
+                                           score_function),
+          current_score, score_function);
+    } else {
+      return best_gain;
+    }
+  }
+
+  [[nodiscard]] static tree_t build_tree(binned_rows_t const& binned,
+                                         std::span<std::size_t> rows,
+                                         histogram_t const& histogram,
                                          auto score_function) {
-    return build_tree(get_pointer_to_rows(rows), score_function);
+    if (rows.empty()) return {};
+    auto const counts = class_counts(
+        binned.classes, rows,
+        [&](std::size_t i) { return binned.class_ids[i]; });
+    if (auto best_gain = find_best_gain<0>(
+            binned, histogram, static_cast<double>(rows.size()),
+            gain_t{.gain = 0.0, .criteria = {}, .split_sets = {}},
+            score_function(counts), score_function);
+        best_gain.gain > 0.0) {
+      auto const true_rows = static_cast<std::size_t>(
+          std::partition(rows.begin(), rows.end(),
+                         [&](std::size_t i) {
+                           return row_takes_true_path(binned.rows[i],
+                                                      best_gain.criteria);
+                         }) -
+          rows.begin());
+      std::array const split_rows{rows.first(true_rows),
+                                  rows.subspan(true_rows)};
+      std::size_t const smaller =
+          split_rows[0].size() <= split_rows[1].size() ? 0 : 1;
+      std::array<histogram_t, 2> split_histograms;
+      split_histograms[smaller] =
+          decision_tree::histogram(binned, split_rows[smaller]);
+      split_histograms[1 - smaller].resize(histogram.size());
+      std::ranges::transform(histogram, split_histograms[smaller],
+                             split_histograms[1 - smaller].begin(),
+                             std::minus<>{});
+      return tree_t{
+          .column_value = best_gain.criteria,
+          .node_data = node_data_t{children_t{
+              .true_path = std::make_unique<tree_t>(build_tree(
+                  binned, split_rows[0], split_histograms[0], score_function)),
+              .false_path = std::make_unique<tree_t>(
+                  build_tree(binned, split_rows[1], split_histograms[1],
+                             score_function))}}};
+    } else
+      return tree_t{.column_value = {},
+                    .node_data = binned.classes.to_result_counts(counts)};
+  }  // NOLINT(clang-analyzer-cplusplus.NewDeleteLeaks)
+
+  [[nodiscard]] static tree_t build_tree_binned(rows_t const& rows,
+                                                std::size_t max_bins,
+                                                auto score_function) {
+    auto const binned = encode_binned_rows(rows, max_bins);
+    row_indices_t all_rows(rows.size());
+    std::iota(all_rows.begin(), all_rows.end(), std::size_t{0});
+    auto const root_histogram = histogram(binned, all_rows);
+    return build_tree(binned, std::span{all_rows}, root_histogram,
+                      class_score(score_function, binned.classes));
   }
-  [[nodiscard]] static tree_t build_tree(rows_t const& rows) {
-    return build_tree(rows, &entropy);
+  [[nodiscard]] static tree_t build_tree_binned(rows_t const& rows,
+                                                std::size_t max_bins = 255) {
+    return build_tree_binned(rows, max_bins, &class_entropy);
   }
 
-  template <std::size_t I, typename V>
+  template <std::size_t I, typename V, typename Observation>
   [[nodiscard]] static bool take_true_branch(V const& query_value,
                                              column_value_t const& column_value,
-                                             observation_t const& observation) {
+                                             Observation const& observation) {
     if constexpr (I < observation_size) {
       if (column_value.column > I) {
         if constexpr (I < observation_size - 1) {
@@ -381,7 +1489,7 @@ struct decision_tree {
       }
       using column_t = observation_column_type<I>;
       if constexpr (std::same_as<V, column_t>) {
-        return splits(query_value, std::get<column_t>(column_value.value));
+        return splits(query_value, column_value);
       } else {
         return false;  // should never be reached}
       }
@@ -390,8 +1498,9 @@ struct decision_tree {
     }
   }
 
+  template <observation_of<Sheet> Observation = observation_t>
   [[nodiscard]] static result_counts_t classify(
-      tree_t const& tree, observation_t const& observation) {
+      tree_t const& tree, Observation const& observation) {
     if (auto result = std::get_if<result_counts_t>(&tree.node_data))
       return *result;
     auto const& children = std::get<children_t>(tree.node_data);
@@ -403,6 +1512,721 @@ struct decision_tree {
       return classify(*children.false_path, observation);
   }
 
+  // Immutable flat form of a tree_t for classification. Internal nodes are
+  // numbered in depth first order and stored as struct of arrays, their
+  // thresholds in one vector per value type. Leaves live in a separate
+  // table; a node reference with leaf_bit set indexes that table. Leaf 0 is
+  // the empty result, reached for missing values and incomplete trees.
+  // leaf_class_counts holds the leaves once more as dense rows over
+  // predict_values for the batch API. A node with a value set stores it
+  // sorted at its threshold index, value_set_sizes holds its size (0 for
+  // plain thresholds). For every internal node,
+  // subtree_columns are the columns its subtree tests and
+  // missing_class_counts the dense result of classify_with_missing_data at
+  // that node when none of them is known.
+  using node_ref_t = std::uint32_t;
+  static constexpr node_ref_t leaf_bit = node_ref_t{1} << 31;
+  using thresholds_t = typename detail::to_vectors<unique_tuple_t>::type;
+
+  struct compiled_tree_t {
+    std::vector<std::uint32_t> columns;
+    std::vector<std::uint32_t> threshold_indices;
+    thresholds_t thresholds;
+    std::vector<node_ref_t> true_paths, false_paths;
+    std::vector<result_counts_t> leaves;
+    node_ref_t root = leaf_bit;
+    std::vector<predict_t> predict_values;
+    std::vector<double> leaf_class_counts;
+    std::vector<std::uint32_t> value_set_sizes;
+    std::vector<column_set_t> subtree_columns;
+    std::vector<double> missing_class_counts;
+  };
+
+  // Weights both sides by their totals, as
+  // combine_children_of_missing_data_node does. counts may alias
+  // true_counts.
+  static void combine_missing_data_counts(
+      std::span<double const> true_counts,
+      std::span<double const> false_counts, std::span<double> counts) {
+    auto const sum_true = class_counts_total(true_counts);
+    auto const sum_false = class_counts_total(false_counts);
+    auto const sum_both = sum_true + sum_false;
+    for (std::size_t id = 0; id < counts.size(); ++id) {
+      counts[id] = true_counts[id] * (sum_true / sum_both);
+      counts[id] += false_counts[id] * (sum_false / sum_both);
+    }
+  }
+
+  [[nodiscard]] static node_ref_t compile_node(compiled_tree_t& compiled,
+                                               tree_t const& tree) {
+    if (auto result = std::get_if<result_counts_t>(&tree.node_data)) {
+      compiled.leaves.push_back(*result);
+      return leaf_bit |
+             static_cast<node_ref_t>(compiled.leaves.size() - 1);
+    }
+    auto const& children = std::get<children_t>(tree.node_data);
+    if (!children.true_path || !children.false_path) return leaf_bit;
+
+    auto node = static_cast<node_ref_t>(compiled.columns.size());
+    compiled.columns.push_back(
+        static_cast<std::uint32_t>(tree.column_value.column));
+    std::visit(
+        [&]<typename V>(V const& threshold) {
+          auto& thresholds = std::get<std::vector<V>>(compiled.thresholds);
+          compiled.threshold_indices.push_back(
+              static_cast<std::uint32_t>(thresholds.size()));
+          if (tree.column_value.value_set.empty())
+            thresholds.push_back(threshold);
+          for (auto const& element : tree.column_value.value_set)
+            thresholds.push_back(std::get<V>(element));
+        },
+        tree.column_value.value);
+    compiled.value_set_sizes.push_back(
+        static_cast<std::uint32_t>(tree.column_value.value_set.size()));
+    compiled.true_paths.push_back(leaf_bit);
+    compiled.false_paths.push_back(leaf_bit);
+    auto true_path = compile_node(compiled, *children.true_path);
+    compiled.true_paths[node] = true_path;
+    auto false_path = compile_node(compiled, *children.false_path);
+    compiled.false_paths[node] = false_path;
+    return node;
+  }
+
+  [[nodiscard]] static compiled_tree_t compile(tree_t const& tree) {
+    compiled_tree_t compiled;
+    compiled.leaves.emplace_back();
+    compiled.root = compile_node(compiled, tree);
+    std::set<predict_t> predict_values;
+    for (auto const& leaf : compiled.leaves)
+      for (auto const& predict_value : leaf | std::views::keys)
+        predict_values.insert(predict_value);
+    compiled.predict_values = {predict_values.begin(), predict_values.end()};
+    auto const class_count = compiled.predict_values.size();
+    compiled.leaf_class_counts.resize(compiled.leaves.size() * class_count);
+    for (std::size_t leaf = 0; leaf < compiled.leaves.size(); ++leaf)
+      for (auto const& [predict_value, count] : compiled.leaves[leaf])
+        compiled.leaf_class_counts[leaf * class_count +
+                                   static_cast<std::size_t>(
+                                       std::ranges::lower_bound(
+                                           compiled.predict_values,
+                                           predict_value) -
+                                       compiled.predict_values.begin())] =
+            count;
+    compile_missing_tables(compiled);
+    return compiled;
+  }
+
+  // Fills subtree_columns and missing_class_counts from the nodes and
+  // leaf_class_counts. Children are numbered after their parent, so a
+  // reverse pass sees them first.
+  static void compile_missing_tables(compiled_tree_t& compiled) {
+    auto const class_count = compiled.predict_values.size();
+    auto const node_count = compiled.columns.size();
+    compiled.subtree_columns.resize(node_count);
+    compiled.missing_class_counts.resize(node_count * class_count);
+    auto missing_counts = [&](node_ref_t node) {
+      return node & leaf_bit
+                 ? std::span{compiled.leaf_class_counts}.subspan(
+                       (node & ~leaf_bit) * class_count, class_count)
+                 : std::span{compiled.missing_class_counts}.subspan(
+                       node * class_count, class_count);
+    };
+    for (auto node = static_cast<node_ref_t>(node_count); node-- > 0;) {
+      auto& columns = compiled.subtree_columns[node];
+      columns.set(compiled.columns[node]);
+      for (auto child : {compiled.true_paths[node], compiled.false_paths[node]})
+        if (!(child & leaf_bit)) columns |= compiled.subtree_columns[child];
+      combine_missing_data_counts(missing_counts(compiled.true_paths[node]),
+                                  missing_counts(compiled.false_paths[node]),
+                                  missing_counts(node));
+    }
+  }
+
+  // The test of node, whose column is I, on the value of that column.
+  template <std::size_t I>
+  [[nodiscard]] static bool value_takes_true_path(
+      compiled_tree_t const& tree, node_ref_t node,
+      observation_column_type<I> const& query_value) {
+    using column_t = observation_column_type<I>;
+    auto const& thresholds = std::get<std::vector<column_t>>(tree.thresholds);
+    auto const first = tree.threshold_indices[node];
+    if constexpr (!std::is_arithmetic_v<column_t>) {
+      if (auto const size = tree.value_set_sizes[node])
+        return std::ranges::binary_search(
+            std::span{thresholds}.subspan(first, size), query_value);
+    }
+    return splits(query_value, thresholds[first]);
+  }
+
+  template <std::size_t I = 0, typename Observation>
+  [[nodiscard]] static std::optional<bool> take_true_path(
+      compiled_tree_t const& tree, node_ref_t node,
+      Observation const& observation) {
+    if constexpr (I < observation_size) {
+      if (tree.columns[node] != I)
+        return take_true_path<I + 1>(tree, node, observation);
+      auto query_value = get_observation_value<I>(observation);
+      if (!query_value) return {};
+      return value_takes_true_path<I>(tree, node, *query_value);
+    } else {
+      return {};  // never reached
+    }
+  }
+
+  // take_true_path for the values of a complete packed observation: no
+  // missing bits are tested.
+  template <std::size_t I = 0, typename Values>
+  [[nodiscard]] static bool take_true_path_unchecked(
+      compiled_tree_t const& tree, node_ref_t node, Values const& values) {
+    if constexpr (I + 1 < observation_size) {
+      if (tree.columns[node] != I)
+        return take_true_path_unchecked<I + 1>(tree, node, values);
+    }
+    return value_takes_true_path<I>(tree, node, std::get<I>(values));
+  }
+
+  // Leaf of observation in the subtree at node.
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static std::size_t classify_leaf(
+      compiled_tree_t const& tree, node_ref_t node,
+      Observation const& observation) {
+    if constexpr (!std::same_as<Observation, observation_t>) {
+      if (observation.complete()) {
+        while (!(node & leaf_bit))
+          node = take_true_path_unchecked(tree, node, observation.values)
+                     ? tree.true_paths[node]
+                     : tree.false_paths[node];
+        return node & ~leaf_bit;
+      }
+    }
+    while (!(node & leaf_bit)) {
+      auto true_path = take_true_path(tree, node, observation);
+      if (!true_path) return 0;
+      node = *true_path ? tree.true_paths[node] : tree.false_paths[node];
+    }
+    return node & ~leaf_bit;
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static std::size_t classify_leaf(
+      compiled_tree_t const& tree, Observation const& observation) {
+    return classify_leaf(tree, tree.root, observation);
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static result_counts_t const& classify(
+      compiled_tree_t const& tree, Observation const& observation) {
+    return tree.leaves[classify_leaf(tree, observation)];
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static column_set_t known_columns(
+      Observation const& observation) {
+    column_set_t known;
+    if constexpr (std::same_as<Observation, observation_t>) {
+      [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+        (known.set(Columns,
+                   get_observation_value<Columns>(observation).has_value()),
+         ...);
+      }(std::make_index_sequence<observation_size>{});
+    } else {
+      for (std::size_t word = 0; word < observation.missing.size(); ++word)
+        known |= column_set_t{~observation.missing[word]}
+                 << (word * Observation::word_bits);
+    }
+    return known;
+  }
+
+  template <typename Observation>
+  static void classify_with_missing_data(compiled_tree_t const& tree,
+                                         node_ref_t node,
+                                         Observation const& observation,
+                                         column_set_t const& known,
+                                         std::span<double> counts) {
+    auto const class_count = tree.predict_values.size();
+    while (!(node & leaf_bit)) {
+      if ((tree.subtree_columns[node] & known).none()) {
+        std::ranges::copy(std::span{tree.missing_class_counts}.subspan(
+                              node * class_count, class_count),
+                          counts.begin());
+        return;
+      }
+      if (auto true_path = take_true_path(tree, node, observation)) {
+        node = *true_path ? tree.true_paths[node] : tree.false_paths[node];
+        continue;
+      }
+      std::vector<double> false_counts(class_count);
+      classify_with_missing_data(tree, tree.true_paths[node], observation,
+                                 known, counts);
+      classify_with_missing_data(tree, tree.false_paths[node], observation,
+                                 known, false_counts);
+      combine_missing_data_counts(counts, false_counts, counts);
+      return;
+    }
+    std::ranges::copy(std::span{tree.leaf_class_counts}.subspan(
+                          (node & ~leaf_bit) * class_count, class_count),
+                      counts.begin());
+  }
+
+  // The results of classify_with_missing_data on the tree_t. A missing
+  // value ends the walk at its node with the precomputed
+  // missing_class_counts unless the subtree tests a known column; only
+  // those subtrees are still walked on both sides. Complete observations
+  // take the plain walk of classify_leaf.
+  template <observation_of<Sheet> Observation = observation_t>
+  static void classify_with_missing_data(compiled_tree_t const& tree,
+                                         Observation const& observation,
+                                         std::span<double> counts) {
+    auto const class_count = tree.predict_values.size();
+    if (counts.size() < class_count)
+      throw std::out_of_range("classify_with_missing_data: counts too small");
+    auto const known = known_columns(observation);
+    if (known.all()) {
+      std::ranges::copy(
+          std::span{tree.leaf_class_counts}.subspan(
+              classify_leaf(tree, observation) * class_count, class_count),
+          counts.begin());
+      return;
+    }
+    classify_with_missing_data(tree, tree.root, observation, known,
+                               counts.first(class_count));
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static result_counts_t classify_with_missing_data(
+      compiled_tree_t const& tree, Observation const& observation) {
+    std::vector<double> counts(tree.predict_values.size());
+    classify_with_missing_data(tree, observation, counts);
+    result_counts_t result_counts;
+    for (std::size_t id = 0; id < counts.size(); ++id)
+      if (counts[id] > 0.0)
+        result_counts.emplace_hint(result_counts.end(),
+                                   tree.predict_values[id], counts[id]);
+    return result_counts;
+  }
+
+  // The batch API walks a tile of observations through the tree one level
+  // at a time, so the loads of neighbouring observations overlap instead of
+  // each walk waiting for its own cache misses.
+  static constexpr std::size_t batch_tile_size = 64;
+
+  // Walks the tile from root, which may be any node of the tree. A tile of
+  // complete packed observations is walked without missing checks.
+  template <typename Observation>
+  static void classify_tile(compiled_tree_t const& tree, node_ref_t root,
+                            std::span<Observation const> observations,
+                            std::span<std::size_t> leaves) {
+    auto checked = [&](node_ref_t node, Observation const& observation) {
+      auto true_path = take_true_path(tree, node, observation);
+      return !true_path  ? leaf_bit
+             : *true_path ? tree.true_paths[node]
+                          : tree.false_paths[node];
+    };
+    if constexpr (!std::same_as<Observation, observation_t>) {
+      if (std::ranges::all_of(observations, &Observation::complete)) {
+        walk_tile(root, observations, leaves,
+                  [&](node_ref_t node, Observation const& observation) {
+                    return take_true_path_unchecked(tree, node,
+                                                    observation.values)
+                               ? tree.true_paths[node]
+                               : tree.false_paths[node];
+                  });
+        return;
+      }
+    }
+    walk_tile(root, observations, leaves, checked);
+  }
+
+  // Moves every observation of the tile one node per level with next, until
+  // all reached a leaf.
+  template <typename Observation>
+  static void walk_tile(node_ref_t root,
+                        std::span<Observation const> observations,
+                        std::span<std::size_t> leaves, auto next) {
+    std::array<node_ref_t, batch_tile_size> nodes;
+    nodes.fill(root);
+    for (bool walking = !(root & leaf_bit); walking;) {
+      walking = false;
+      for (std::size_t i = 0; i < observations.size(); ++i) {
+        auto& node = nodes[i];
+        if (node & leaf_bit) continue;
+        node = next(node, observations[i]);
+        walking = walking || !(node & leaf_bit);
+      }
+    }
+    for (std::size_t i = 0; i < observations.size(); ++i)
+      leaves[i] = nodes[i] & ~leaf_bit;
+  }
+
+  // Writes the leaf index of every observation into leaves. The batch API
+  // takes observation_t as well as packed_observation_t.
+  static void classify_batch(compiled_tree_t const& tree,
+                             observations_of<Sheet> auto const& batch,
+                             std::span<std::size_t> leaves) {
+    std::span<std::ranges::range_value_t<decltype(batch)> const> observations{
+        batch};
+    if (leaves.size() < observations.size())
+      throw std::out_of_range("classify_batch: leaves too small");
+    for (std::size_t begin = 0; begin < observations.size();
+         begin += batch_tile_size) {
+      auto const size =
+          std::min(batch_tile_size, observations.size() - begin);
+      classify_tile(tree, tree.root, observations.subspan(begin, size),
+                    leaves.subspan(begin, size));
+    }
+  }
+
+  // Writes the class counts of every observation into counts, one row of
+  // tree.predict_values.size() values per observation.
+  static void classify_batch(compiled_tree_t const& tree,
+                             observations_of<Sheet> auto const& batch,
+                             std::span<double> counts) {
+    std::span<std::ranges::range_value_t<decltype(batch)> const> observations{
+        batch};
+    auto const class_count = tree.predict_values.size();
+    if (counts.size() < observations.size() * class_count)
+      throw std::out_of_range("classify_batch: counts too small");
+    std::array<std::size_t, batch_tile_size> leaves;
+    for (std::size_t begin = 0; begin < observations.size();
+         begin += batch_tile_size) {
+      auto const size =
+          std::min(batch_tile_size, observations.size() - begin);
+      classify_tile(tree, tree.root, observations.subspan(begin, size),
+                    std::span{leaves}.first(size));
+      for (std::size_t i = 0; i < size; ++i)
+        std::ranges::copy(
+            std::span{tree.leaf_class_counts}.subspan(leaves[i] * class_count,
+                                                      class_count),
+            counts.subspan((begin + i) * class_count).begin());
+    }
+  }
+
+  // Splits the batch into chunks of whole tiles and classifies them as tasks
+  // on the pool.
+  template <typename Output>
+  static void classify_batch(thread_pool& pool, compiled_tree_t const& tree,
+                             observations_of<Sheet> auto const& batch,
+                             std::span<Output> output) {
+    std::span<std::ranges::range_value_t<decltype(batch)> const> observations{
+        batch};
+    auto const width =
+        std::same_as<Output, double> ? tree.predict_values.size() : 1;
+    if (output.size() < observations.size() * width)
+      throw std::out_of_range("classify_batch: output too small");
+    auto const tiles = (observations.size() + batch_tile_size - 1) /
+                       batch_tile_size;
+    auto const chunk_size =
+        batch_tile_size * ((tiles + pool.size() - 1) / pool.size());
+    std::vector<std::future<void>> chunks;
+    wait_guard const guard{pool, chunks};
+    for (std::size_t begin = 0; begin < observations.size();
+         begin += chunk_size) {
+      auto const size = std::min(chunk_size, observations.size() - begin);
+      chunks.push_back(pool.submit([&, begin, size] {
+        classify_batch(tree, observations.subspan(begin, size),
+                       output.subspan(begin * width, size * width));
+      }));
+    }
+    for (auto& chunk : chunks) pool.get(chunk);
+  }
+
+  // Model files, see model_file.hpp. Numeric columns split with >=, all
+  // others with ==, as in splits.
+  static_assert(leaf_bit == model_file::leaf_bit);
+
+  template <std::size_t I = 0>
+  [[nodiscard]] static model_file::node_t to_model_node(
+      compiled_tree_t const& tree, node_ref_t node) {
+    if constexpr (I < observation_size) {
+      if (tree.columns[node] != I) return to_model_node<I + 1>(tree, node);
+      using column_t = observation_column_type<I>;
+      return {
+          .column = tree.columns[node],
+          .op = std::is_arithmetic_v<column_t> && !std::same_as<column_t, bool>
+                    ? model_file::op_t::greater_equal
+                    : model_file::op_t::equal,
+          .true_path = tree.true_paths[node],
+          .false_path = tree.false_paths[node],
+          .threshold = model_file::to_scalar(std::get<std::vector<column_t>>(
+              tree.thresholds)[tree.threshold_indices[node]])};
+    } else {
+      return {};  // never reached
+    }
+  }
+
+  [[nodiscard]] static model_file::model_t to_model(
+      compiled_tree_t const& tree) {
+    if (std::ranges::any_of(tree.value_set_sizes,
+                            [](auto size) { return size > 0; }))
+      throw std::invalid_argument("to_model: value set splits");
+    model_file::model_t model;
+    model.leaf_count = tree.leaves.size();
+    model.leaf_class_counts = tree.leaf_class_counts;
+    model.root = tree.root;
+    for (auto const& predict_value : tree.predict_values)
+      model.predict_values.push_back(model_file::to_scalar(predict_value));
+    for (node_ref_t node = 0; node < tree.columns.size(); ++node)
+      model.nodes.push_back(to_model_node(tree, node));
+    return model;
+  }
+  [[nodiscard]] static model_file::model_t to_model(tree_t const& tree) {
+    return to_model(compile(tree));
+  }
+
+  // Writes tree as a header of nested ifs, see model_codegen.hpp.
+  static void generate_header(tree_t const& tree, std::ostream& os,
+                              std::string_view name_space) {
+    model_file::generate_header(to_model(tree), os, name_space);
+  }
+
+  template <std::size_t I = 0, typename Observation>
+  [[nodiscard]] static std::optional<bool> take_true_path(
+      model_file::model_view const& model, std::uint32_t node,
+      Observation const& observation) {
+    if constexpr (I < observation_size) {
+      if (model.column(node) != I)
+        return take_true_path<I + 1>(model, node, observation);
+      auto query_value = get_observation_value<I>(observation);
+      if (!query_value) return {};
+      return model.take_true_path(node,
+                                  model_file::to_scalar_view(*query_value));
+    } else {
+      throw std::out_of_range("model file: column out of range");
+    }
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static std::size_t classify_leaf(
+      model_file::model_view const& model, Observation const& observation) {
+    auto node = model.root();
+    while (!model.is_leaf(node)) {
+      auto true_path = take_true_path(model, node, observation);
+      if (!true_path) return 0;
+      node = *true_path ? model.true_path(node) : model.false_path(node);
+    }
+    return model.leaf(node);
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static result_counts_t classify(
+      model_file::model_view const& model, Observation const& observation) {
+    auto const leaf = classify_leaf(model, observation);
+    result_counts_t result_counts;
+    for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id)
+      if (auto count = model.leaf_count(leaf, class_id); count > 0.0)
+        result_counts.emplace(
+            model_file::from_scalar<predict_t>(model.predict_value(class_id)),
+            count);
+    return result_counts;
+  }
+
+  // Compile time training for rows of literal types, e.g. a constexpr
+  // std::array of tulpe_sheet rows over arithmetic values, bool and
+  // std::string_view. build_static_tree uses std::vector only as transient
+  // scratch; the result is a static_tree_t sized by the row count, which
+  // can be a constexpr constant, and classify on it is constexpr as well.
+  // Candidates are scored by the sweep_column of build_tree, so for a score
+  // function that evaluates alike at compile and run time, such as
+  // class_gini_impurity, the trees are those of build_tree. During constant
+  // evaluation class_entropy uses detail::log2, which may be a few ulp off
+  // std::log2, so with it two splits whose gains differ by less than that
+  // may resolve either way.
+  template <std::size_t RowCount>
+  struct static_tree_t {
+    static constexpr std::size_t node_capacity =
+        RowCount > 0 ? RowCount - 1 : 0;
+    static constexpr std::size_t leaf_capacity = RowCount + 1;
+    using leaf_entry_t = std::pair<predict_t, double>;
+
+    std::size_t node_count = 0;
+    std::array<std::uint32_t, node_capacity> columns{};
+    std::array<values_variant_t, node_capacity> thresholds{};
+    std::array<node_ref_t, node_capacity> true_paths{}, false_paths{};
+    node_ref_t root = leaf_bit;
+    // The class counts of leaf l are leaf_entries[leaf_begin[l],
+    // leaf_begin[l + 1]), ordered by predict value. Leaf 0 is empty.
+    std::size_t leaf_count = 1;
+    std::array<std::size_t, leaf_capacity + 1> leaf_begin{};
+    std::array<leaf_entry_t, RowCount> leaf_entries{};
+  };
+
+  struct static_gain_t {
+    double gain = 0.0;
+    std::uint32_t column = 0;
+    values_variant_t value{};
+  };
+
+  template <std::size_t Column>
+  static constexpr void find_static_best_gain(
+      std::span<predict_t const> classes, std::span<row_t const* const> rows,
+      static_gain_t& best_gain, double current_score, auto score_function) {
+    if constexpr (Column < observation_size) {
+      using column_t = row_column_type<Column>;
+      auto const class_count = classes.size();
+      auto const row_count = static_cast<double>(rows.size());
+      std::vector<std::pair<column_t, std::size_t>> values;
+      for (row_t const* row : rows)
+        values.emplace_back(
+            get_observation_value<Column>(*row),
+            static_cast<std::size_t>(
+                std::ranges::lower_bound(classes,
+                                         Sheet::get_predict_value(*row)) -
+                classes.begin()));
+      std::sort(values.begin(), values.end());
+
+      // The runs of equal values become the value -> class counts table
+      // of find_best_gain_in_column.
+      std::vector<std::pair<column_t, std::vector<double>>> counts_by_value;
+      std::vector<double> total(class_count), below(class_count),
+          complement(class_count);
+      for (auto const& [value, id] : values) {
+        if (counts_by_value.empty() || counts_by_value.back().first < value)
+          counts_by_value.emplace_back(value, std::vector<double>(class_count));
+        ++counts_by_value.back().second[id];
+        ++total[id];
+      }
+      sweep_column<column_t>(
+          counts_by_value, total, below, complement, row_count, current_score,
+          score_function, [&](column_t const& value, double possible_gain) {
+            if (possible_gain > best_gain.gain)
+              best_gain = {possible_gain, Column, value};
+          });
+      find_static_best_gain<Column + 1>(classes, rows, best_gain,
+                                        current_score, score_function);
+    }
+  }
+
+  template <std::size_t RowCount>
+  static constexpr node_ref_t build_static_node(
+      static_tree_t<RowCount>& tree, std::span<predict_t const> classes,
+      std::span<row_t const*> rows, auto score_function) {
+    std::vector<double> counts(classes.size());
+    for (row_t const* row : rows)
+      ++counts[static_cast<std::size_t>(
+          std::ranges::lower_bound(classes, Sheet::get_predict_value(*row)) -
+          classes.begin())];
+    static_gain_t best_gain;
+    find_static_best_gain<0>(classes, rows, best_gain,
+                             score_function(std::span<double const>{counts}),
+                             score_function);
+    if (best_gain.gain > 0.0) {
+      auto const true_rows = static_cast<std::size_t>(
+          std::partition(rows.begin(), rows.end(),
+                         [&](row_t const* row) {
+                           return row_takes_true_path(
+                               *row, {best_gain.column, best_gain.value});
+                         }) -
+          rows.begin());
+      auto const node = static_cast<node_ref_t>(tree.node_count++);
+      tree.columns[node] = best_gain.column;
+      tree.thresholds[node] = best_gain.value;
+      tree.true_paths[node] = build_static_node(tree, classes,
+                                                rows.first(true_rows),
+                                                score_function);
+      tree.false_paths[node] = build_static_node(
+          tree, classes, rows.subspan(true_rows), score_function);
+      return node;
+    }
+    auto const leaf = tree.leaf_count++;
+    auto entry = tree.leaf_begin[leaf];
+    for (std::size_t id = 0; id < classes.size(); ++id)
+      if (counts[id] > 0.0)
+        tree.leaf_entries[entry++] = {classes[id], counts[id]};
+    tree.leaf_begin[leaf + 1] = entry;
+    return leaf_bit | static_cast<node_ref_t>(leaf);
+  }
+
+  template <std::size_t RowCount>
+  [[nodiscard]] static constexpr static_tree_t<RowCount> build_static_tree(
+      std::array<row_t, RowCount> const& rows, auto score_function) {
+    std::vector<predict_t> classes;
+    std::vector<row_t const*> row_pointers;
+    for (auto const& row : rows) {
+      classes.push_back(Sheet::get_predict_value(row));
+      row_pointers.push_back(&row);
+    }
+    std::sort(classes.begin(), classes.end());
+    classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+    static_tree_t<RowCount> tree;
+    if (!rows.empty())
+      tree.root = build_static_node(tree, std::span<predict_t const>{classes},
+                                    std::span{row_pointers}, score_function);
+    return tree;
+  }
+  template <std::size_t RowCount>
+  [[nodiscard]] static constexpr static_tree_t<RowCount> build_static_tree(
+      std::array<row_t, RowCount> const& rows) {
+    return build_static_tree(rows, &class_entropy);
+  }
+
+  template <std::size_t I = 0, std::size_t RowCount, typename Observation>
+  [[nodiscard]] static constexpr std::optional<bool> take_true_path(
+      static_tree_t<RowCount> const& tree, node_ref_t node,
+      Observation const& observation) {
+    if constexpr (I < observation_size) {
+      if (tree.columns[node] != I)
+        return take_true_path<I + 1>(tree, node, observation);
+      auto query_value = get_observation_value<I>(observation);
+      if (!query_value) return {};
+      return splits(*query_value, std::get<observation_column_type<I>>(
+                                      tree.thresholds[node]));
+    } else {
+      return {};  // never reached
+    }
+  }
+
+  template <std::size_t RowCount,
+            observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static constexpr std::size_t classify_leaf(
+      static_tree_t<RowCount> const& tree, Observation const& observation) {
+    auto node = tree.root;
+    while (!(node & leaf_bit)) {
+      auto true_path = take_true_path(tree, node, observation);
+      if (!true_path) return 0;
+      node = *true_path ? tree.true_paths[node] : tree.false_paths[node];
+    }
+    return node & ~leaf_bit;
+  }
+
+  // The class counts of the leaf, ordered by predict value.
+  template <std::size_t RowCount,
+            observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] static constexpr auto classify(
+      static_tree_t<RowCount> const& tree, Observation const& observation)
+      -> std::span<typename static_tree_t<RowCount>::leaf_entry_t const> {
+    auto const leaf = classify_leaf(tree, observation);
+    return std::span{tree.leaf_entries}.subspan(
+        tree.leaf_begin[leaf],
+        tree.leaf_begin[leaf + 1] - tree.leaf_begin[leaf]);
+  }
+
+  template <std::size_t RowCount>
+  [[nodiscard]] static tree_t to_tree(static_tree_t<RowCount> const& tree,
+                                      node_ref_t node) {
+    if (node & leaf_bit) {
+      auto const leaf = node & ~leaf_bit;
+      auto const entries = std::span{tree.leaf_entries}.subspan(
+          tree.leaf_begin[leaf],
+          tree.leaf_begin[leaf + 1] - tree.leaf_begin[leaf]);
+      return tree_t{.column_value = {},
+                    .node_data = result_counts_t(entries.begin(),
+                                                 entries.end())};
+    }
+    return tree_t{
+        .column_value = {tree.columns[node], tree.thresholds[node]},
+        .node_data = node_data_t{children_t{
+            .true_path =
+                std::make_unique<tree_t>(to_tree(tree, tree.true_paths[node])),
+            .false_path = std::make_unique<tree_t>(
+                to_tree(tree, tree.false_paths[node]))}}};
+  }
+  // The tree_t form, e.g. for to_string and prune.
+  template <std::size_t RowCount>
+  [[nodiscard]] static tree_t to_tree(static_tree_t<RowCount> const& tree) {
+    if (tree.root == leaf_bit) return {};
+    return to_tree(tree, tree.root);
+  }
+
   [[nodiscard]] static double sum(result_counts_t const& result_counts) {
     auto total = 0.0;
     for (auto const& [result, count] : result_counts) total += count;
@@ -414,8 +2238,9 @@ struct decision_tree {
     for (auto const& [result, count] : from) to[result] += count * weight;
   }
 
+  template <typename Observation>
   [[nodiscard]] static result_counts_t combine_children_of_missing_data_node(
-      children_t const& children, observation_t const& observation) {
+      children_t const& children, Observation const& observation) {
     auto result_true =
         classify_with_missing_data(*children.true_path, observation);
     auto result_false =
@@ -429,10 +2254,10 @@ struct decision_tree {
     return combined_result_counts;
   }
 
-  template <std::size_t I>
+  template <std::size_t I, typename Observation>
   [[nodiscard]] static result_counts_t classify_column_with_missing_data(
-      tree_t const& tree, observation_t const& observation) {
-    if constexpr (I < std::tuple_size_v<observation_t>) {
+      tree_t const& tree, Observation const& observation) {
+    if constexpr (I < observation_size) {
       if (I < tree.column_value.column)
         return classify_column_with_missing_data<I + 1>(tree, observation);
 
@@ -450,8 +2275,9 @@ struct decision_tree {
     }
   }
 
+  template <observation_of<Sheet> Observation = observation_t>
   [[nodiscard]] static result_counts_t classify_with_missing_data(
-      tree_t const& tree, observation_t const& observation) {
+      tree_t const& tree, Observation const& observation) {
     if (auto result = std::get_if<result_counts_t>(&tree.node_data))
       return *result;
     return classify_column_with_missing_data<0>(tree, observation);
@@ -476,37 +2302,54 @@ struct decision_tree {
     return score(pruned) - score_unpruned(true_result, false_result, score);
   }
 
-  [[nodiscard]] static children_t prune_children(tree_t const& tree,
-                                                 double min_gain, auto score) {
+  [[nodiscard]] static children_t prune_children(
+      tree_t const& tree, double min_gain, auto score,
+      std::pmr::memory_resource* resource) {
     auto const& original_children = std::get<children_t>(tree.node_data);
-    return {.true_path = std::make_unique<tree_t>(
-                prune(*original_children.true_path, min_gain, score)),
-            .false_path = std::make_unique<tree_t>(
-                prune(*original_children.false_path, min_gain, score))};
+    return {
+        .true_path = make_node(
+            prune(*original_children.true_path, min_gain, score, resource),
+            resource),
+        .false_path = make_node(
+            prune(*original_children.false_path, min_gain, score, resource),
+            resource)};
   }
 
-  [[nodiscard]] static tree_t prune(tree_t const& tree, double min_gain,
-                                    auto score) {
+  [[nodiscard]] static tree_t prune(
+      tree_t const& tree, double min_gain, auto score,
+      std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
     if (std::holds_alternative<result_counts_t>(tree.node_data))
       return tree_t{.column_value = tree.column_value,
-                    .node_data = std::get<result_counts_t>(tree.node_data)};
+                    .node_data = result_counts_t{
+                        std::get<result_counts_t>(tree.node_data), resource}};
 
     tree_t pruned{.column_value = tree.column_value,
-                  .node_data = prune_children(tree, min_gain, score)};
+                  .node_data = prune_children(tree, min_gain, score, resource)};
     auto& pruned_children = std::get<children_t>(pruned.node_data);
     if (auto true_result =
             std::get_if<result_counts_t>(&pruned_children.true_path->node_data))
       if (auto false_result = std::get_if<result_counts_t>(
               &pruned_children.false_path->node_data))
-        if (auto pruned_result = as_one(*true_result, *false_result);
+        if (auto pruned_result = as_one(
+                result_counts_t{*true_result, resource}, *false_result);
             gain(pruned_result, *true_result, *false_result, score) < min_gain)
-          pruned.node_data = pruned_result;
+          pruned.node_data = std::move(pruned_result);
     return pruned;
   }
 
   [[nodiscard]] static tree_t prune(tree_t const& tree, double min_gain) {
     return prune(tree, min_gain, &entropy);
   }
+
+  [[nodiscard]] static tree_t prune(std::pmr::memory_resource* resource,
+                                    tree_t const& tree, double min_gain,
+                                    auto score) {
+    return prune(tree, min_gain, score, resource);
+  }
+  [[nodiscard]] static tree_t prune(std::pmr::memory_resource* resource,
+                                    tree_t const& tree, double min_gain) {
+    return prune(tree, min_gain, &entropy, resource);
+  }
 };
 
 }  // namespace bit_factory::ml
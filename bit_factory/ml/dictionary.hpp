@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bit_factory::ml {
+
+// Dense id of an interned string. Not arithmetic, so trees split on it
+// with ==, as on the strings.
+struct category_t {
+  std::uint32_t id = std::numeric_limits<std::uint32_t>::max();
+
+  auto operator<=>(category_t const&) const = default;
+  friend std::ostream& operator<<(std::ostream& os, category_t category) {
+    return os << '#' << category.id;
+  }
+};
+
+// The strings of one column. Ids follow the sorted order of the strings,
+// so candidates are visited in the same order as on the strings and
+// training on ids builds the same trees.
+class dictionary_t {
+ public:
+  // Strings not in the dictionary map to unknown, which equals no
+  // threshold, as an unseen string equals none.
+  static constexpr category_t unknown{};
+
+  dictionary_t() = default;
+  explicit dictionary_t(std::vector<std::string> strings)
+      : strings_(std::move(strings)) {
+    std::ranges::sort(strings_);
+    auto const [first, last] = std::ranges::unique(strings_);
+    strings_.erase(first, last);
+    ids_.reserve(strings_.size());
+    for (std::size_t id = 0; id < strings_.size(); ++id)
+      ids_.emplace(strings_[id], static_cast<std::uint32_t>(id));
+  }
+
+  [[nodiscard]] category_t find(std::string_view string) const {
+    if (auto found = ids_.find(string); found != ids_.end())
+      return {found->second};
+    return unknown;
+  }
+  [[nodiscard]] std::string const& string(category_t category) const {
+    return strings_.at(category.id);
+  }
+  [[nodiscard]] std::size_t size() const { return strings_.size(); }
+
+ private:
+  struct hash_t {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view string) const {
+      return std::hash<std::string_view>{}(string);
+    }
+  };
+
+  std::vector<std::string> strings_;
+  std::unordered_map<std::string, std::uint32_t, hash_t, std::equal_to<>>
+      ids_;
+};
+
+}  // namespace bit_factory::ml
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <bit_factory/ml/decision_tree.hpp>
+#include <bit_factory/ml/dictionary.hpp>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace bit_factory::ml {
+
+namespace detail {
+
+template <bool Observation, typename Value>
+using encoded_t =
+    std::conditional_t<Observation && std::same_as<Value, std::string>,
+                       category_t, Value>;
+
+template <auto Labels, typename Indices, typename... Values>
+struct encoded_sheet;
+
+template <auto Labels, std::size_t... Columns, typename... Values>
+struct encoded_sheet<Labels, std::index_sequence<Columns...>, Values...> {
+  using type = tulpe_sheet<
+      Labels, encoded_t<(Columns + 1 < sizeof...(Values)), Values>...>;
+};
+
+}  // namespace detail
+
+// Opt-in dictionary encoding of the std::string observation columns of a
+// tulpe_sheet. The encoder interns the strings of the training rows once;
+// training and classification then run on decision_tree<encoded_sheet_t>,
+// comparing and copying 32 bit ids instead of strings. The predict column
+// is kept, so classify results are unchanged. decode maps a tree back to
+// the strings for printing, pruning or saving.
+template <auto Labels, typename... Values>
+class dictionary_encoder {
+ public:
+  using source_sheet_t = tulpe_sheet<Labels, Values...>;
+  using encoded_sheet_t = typename detail::encoded_sheet<
+      Labels, std::index_sequence_for<Values...>, Values...>::type;
+  using source_tree = decision_tree<source_sheet_t>;
+  using encoded_tree = decision_tree<encoded_sheet_t>;
+  static constexpr std::size_t observation_size =
+      source_sheet_t::observation_size;
+
+  explicit dictionary_encoder(typename source_tree::rows_t const& rows) {
+    [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      (intern<Columns>(rows), ...);
+    }(std::make_index_sequence<observation_size>{});
+  }
+
+  [[nodiscard]] dictionary_t const& dictionary(std::size_t column) const {
+    return dictionaries_.at(column);
+  }
+
+  [[nodiscard]] typename encoded_tree::rows_t encode(
+      typename source_tree::rows_t const& rows) const {
+    typename encoded_tree::rows_t encoded;
+    encoded.reserve(rows.size());
+    for (auto const& row : rows) encoded.push_back(encode(row));
+    return encoded;
+  }
+
+  [[nodiscard]] typename encoded_tree::row_t encode(
+      typename source_tree::row_t const& row) const {
+    return [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      return typename encoded_tree::row_t{
+          encode_value<Columns>(std::get<Columns>(row))...};
+    }(std::index_sequence_for<Values...>{});
+  }
+
+  [[nodiscard]] typename encoded_tree::observation_t encode(
+      typename source_tree::observation_t const& observation) const {
+    return [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      return typename encoded_tree::observation_t{
+          encode_optional<Columns>(std::get<Columns>(observation))...};
+    }(std::make_index_sequence<observation_size>{});
+  }
+
+  [[nodiscard]] typename source_tree::tree_t decode(
+      typename encoded_tree::tree_t const& tree) const {
+    using source_t = typename source_tree::tree_t;
+    if (auto result = std::get_if<typename encoded_tree::result_counts_t>(
+            &tree.node_data))
+      return source_t{.column_value = {}, .node_data = *result};
+    auto const& children =
+        std::get<typename encoded_tree::children_t>(tree.node_data);
+    auto decode_path = [&](auto const& path) {
+      return path ? std::make_unique<source_t>(decode(*path)) : nullptr;
+    };
+    auto decode_value = [&](auto const& value) {
+      return std::visit(
+          [&]<typename V>(
+              V const& v) -> typename source_tree::values_variant_t {
+            if constexpr (std::same_as<V, category_t>)
+              return dictionaries_[tree.column_value.column].string(v);
+            else
+              return v;
+          },
+          value);
+    };
+    typename source_tree::column_value_t column_value{
+        .column = tree.column_value.column,
+        .value = decode_value(tree.column_value.value)};
+    // decoded strings keep the order of their ids
+    for (auto const& element : tree.column_value.value_set)
+      column_value.value_set.push_back(decode_value(element));
+    return source_t{
+        .column_value = std::move(column_value),
+        .node_data = typename source_tree::node_data_t{
+            typename source_tree::children_t{
+                .true_path = decode_path(children.true_path),
+                .false_path = decode_path(children.false_path)}}};
+  }
+
+ private:
+  template <std::size_t Column>
+  void intern(typename source_tree::rows_t const& rows) {
+    using column_t = std::tuple_element_t<Column, std::tuple<Values...>>;
+    if constexpr (std::same_as<column_t, std::string>) {
+      std::vector<std::string> strings;
+      strings.reserve(rows.size());
+      for (auto const& row : rows) strings.push_back(std::get<Column>(row));
+      dictionaries_[Column] = dictionary_t{std::move(strings)};
+    }
+  }
+
+  template <std::size_t Column, typename V>
+  [[nodiscard]] auto encode_value(V const& value) const {
+    if constexpr (Column < observation_size &&
+                  std::same_as<V, std::string>)
+      return dictionaries_[Column].find(value);
+    else
+      return value;
+  }
+
+  template <std::size_t Column, typename V>
+  [[nodiscard]] auto encode_optional(std::optional<V> const& value) const {
+    using encoded_t = decltype(encode_value<Column>(std::declval<V>()));
+    if (!value) return std::optional<encoded_t>{};
+    return std::optional<encoded_t>{encode_value<Column>(*value)};
+  }
+
+  std::array<dictionary_t, observation_size> dictionaries_;
+};
+
+}  // namespace bit_factory::ml
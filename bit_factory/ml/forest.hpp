@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit_factory/ml/decision_tree.hpp>
+#include <bit_factory/ml/thread_pool.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <future>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bit_factory::ml {
+
+// Random forest over decision_tree<Sheet>. Every tree is trained on a
+// bootstrap sample of the rows and searches a random subset of the columns
+// at each node; the trees are trained as tasks on a pool. The trained
+// trees are compiled into a single compiled_tree_t, one root per tree, so
+// the whole ensemble lives in one set of flat arrays. classify averages
+// the class distributions of the leaves the trees reach into a dense vote
+// vector over predict_values.
+template <typename Sheet>
+class forest {
+ public:
+  using tree = decision_tree<Sheet>;
+  using rows_t = typename tree::rows_t;
+  using observation_t = typename tree::observation_t;
+  using predict_t = typename tree::predict_t;
+  using compiled_tree_t = typename tree::compiled_tree_t;
+  using node_ref_t = typename tree::node_ref_t;
+  static constexpr std::size_t observation_size = tree::observation_size;
+
+  struct options_t {
+    std::size_t tree_count = 100;
+    // Columns searched per node, 0 for the square root of observation_size
+    // rounded up.
+    std::size_t feature_count = 0;
+    // Trains every tree on all rows if false.
+    bool bootstrap = true;
+    // Tree i draws from a std::mt19937_64 seeded with seed + i, so a forest
+    // does not depend on the scheduling of its trees.
+    std::uint64_t seed = 0;
+  };
+
+  [[nodiscard]] static forest train(thread_pool& pool, rows_t const& rows,
+                                    options_t const& options,
+                                    auto score_function) {
+    return train(&pool, rows, options, score_function);
+  }
+  [[nodiscard]] static forest train(thread_pool& pool, rows_t const& rows,
+                                    options_t const& options = {}) {
+    return train(&pool, rows, options, &tree::class_entropy);
+  }
+  [[nodiscard]] static forest train(rows_t const& rows,
+                                    options_t const& options,
+                                    auto score_function) {
+    return train(nullptr, rows, options, score_function);
+  }
+  [[nodiscard]] static forest train(rows_t const& rows,
+                                    options_t const& options = {}) {
+    return train(nullptr, rows, options, &tree::class_entropy);
+  }
+
+  [[nodiscard]] std::vector<predict_t> const& predict_values() const {
+    return compiled_.predict_values;
+  }
+  [[nodiscard]] std::size_t tree_count() const { return roots_.size(); }
+  // All trees in one set of flat arrays, including the missing value
+  // tables. Its root is unused: the trees start at roots().
+  [[nodiscard]] compiled_tree_t const& compiled() const { return compiled_; }
+  [[nodiscard]] std::span<node_ref_t const> roots() const { return roots_; }
+
+  // Writes the mean of the trees' leaf distributions into votes, one value
+  // per predict value. Trees reaching a missing value vote for nothing.
+  // Takes observation_t as well as packed observations.
+  template <observation_of<Sheet> Observation = observation_t>
+  void classify(Observation const& observation,
+                std::span<double> votes) const {
+    auto const class_count = predict_values().size();
+    if (votes.size() < class_count)
+      throw std::out_of_range("forest::classify: votes too small");
+    std::ranges::fill(votes.first(class_count), 0.0);
+    for (auto root : roots_)
+      add_votes(tree::classify_leaf(compiled_, root, observation), votes);
+  }
+
+  template <observation_of<Sheet> Observation = observation_t>
+  [[nodiscard]] std::vector<double> classify(
+      Observation const& observation) const {
+    std::vector<double> votes(predict_values().size());
+    classify(observation, votes);
+    return votes;
+  }
+
+  // Writes the votes of every observation into votes, one row of
+  // predict_values().size() values per observation. Every tile of
+  // observations walks all trees before the next tile is loaded.
+  void classify_batch(observations_of<Sheet> auto const& batch,
+                      std::span<double> votes) const {
+    std::span<std::ranges::range_value_t<decltype(batch)> const> observations{
+        batch};
+    auto const class_count = predict_values().size();
+    if (votes.size() < observations.size() * class_count)
+      throw std::out_of_range("forest::classify_batch: votes too small");
+    std::ranges::fill(votes.first(observations.size() * class_count), 0.0);
+    std::array<std::size_t, tree::batch_tile_size> leaves;
+    for (std::size_t begin = 0; begin < observations.size();
+         begin += tree::batch_tile_size) {
+      auto const size =
+          std::min(tree::batch_tile_size, observations.size() - begin);
+      for (auto root : roots_) {
+        tree::classify_tile(compiled_, root,
+                            observations.subspan(begin, size),
+                            std::span{leaves}.first(size));
+        for (std::size_t i = 0; i < size; ++i)
+          add_votes(leaves[i], votes.subspan((begin + i) * class_count,
+                                             class_count));
+      }
+    }
+  }
+
+  // Splits the batch into chunks of whole tiles and classifies them as
+  // tasks on the pool.
+  void classify_batch(thread_pool& pool,
+                      observations_of<Sheet> auto const& batch,
+                      std::span<double> votes) const {
+    std::span<std::ranges::range_value_t<decltype(batch)> const> observations{
+        batch};
+    auto const class_count = predict_values().size();
+    if (votes.size() < observations.size() * class_count)
+      throw std::out_of_range("forest::classify_batch: votes too small");
+    auto const tiles = (observations.size() + tree::batch_tile_size - 1) /
+                       tree::batch_tile_size;
+    auto const chunk_size =
+        tree::batch_tile_size * ((tiles + pool.size() - 1) / pool.size());
+    std::vector<std::future<void>> chunks;
+    wait_guard const guard{pool, chunks};
+    for (std::size_t begin = 0; begin < observations.size();
+         begin += chunk_size) {
+      auto const size = std::min(chunk_size, observations.size() - begin);
+      chunks.push_back(pool.submit([&, begin, size] {
+        classify_batch(observations.subspan(begin, size),
+                       votes.subspan(begin * class_count, size * class_count));
+      }));
+    }
+    for (auto& chunk : chunks) pool.get(chunk);
+  }
+
+ private:
+  using classes_t = typename tree::classes_t;
+  using row_range_t = typename tree::row_range_t;
+  using column_set_t = typename tree::column_set_t;
+
+  forest() = default;
+
+  [[nodiscard]] static forest train(thread_pool* pool, rows_t const& rows,
+                                    options_t const& options,
+                                    auto score_function) {
+    auto const pointer_to_rows = tree::get_pointer_to_rows(rows);
+    auto const classes = tree::encode_classes(pointer_to_rows);
+    auto const score = tree::class_score(score_function, classes);
+    auto feature_count = options.feature_count;
+    if (feature_count == 0)
+      while (feature_count * feature_count < observation_size) ++feature_count;
+
+    auto build = [&](std::size_t index) {
+      std::mt19937_64 rng{options.seed + index};
+      auto sample = pointer_to_rows;
+      if (options.bootstrap) {
+        std::uniform_int_distribution<std::size_t> draw{
+            0, pointer_to_rows.size() - 1};
+        for (auto& row : sample) row = pointer_to_rows[draw(rng)];
+      }
+      auto draw_columns = [&] { return sample_columns(feature_count, rng); };
+      return tree::compile(tree::template build_tree<no_build_observer>(
+          classes, row_range_t{sample}, score, nullptr,
+          std::pmr::get_default_resource(), false, nullptr, &draw_columns));
+    };
+
+    forest result;
+    result.compiled_.predict_values = classes.predict_values;
+    result.compiled_.leaves.emplace_back();
+    if (pool) {
+      std::vector<std::future<compiled_tree_t>> trees;
+      wait_guard const guard{*pool, trees};
+      for (std::size_t index = 0; index < options.tree_count; ++index)
+        trees.push_back(pool->submit([&, index] { return build(index); }));
+      for (auto& compiled : trees) result.append(pool->get(compiled));
+    } else {
+      for (std::size_t index = 0; index < options.tree_count; ++index)
+        result.append(build(index));
+    }
+    result.finish(classes);
+    return result;
+  }
+
+  // feature_count distinct columns, a partial Fisher-Yates shuffle.
+  [[nodiscard]] static column_set_t sample_columns(std::size_t feature_count,
+                                                   std::mt19937_64& rng) {
+    std::array<std::size_t, observation_size> columns;
+    std::iota(columns.begin(), columns.end(), std::size_t{0});
+    column_set_t sample;
+    for (std::size_t i = 0; i < std::min(feature_count, observation_size);
+         ++i) {
+      std::uniform_int_distribution<std::size_t> draw{i,
+                                                       observation_size - 1};
+      std::swap(columns[i], columns[draw(rng)]);
+      sample.set(columns[i]);
+    }
+    return sample;
+  }
+
+  // Appends the nodes, thresholds and leaves of compiled, renumbered after
+  // the trees before it. The empty leaf 0 is shared.
+  void append(compiled_tree_t const& compiled) {
+    auto const node_offset = static_cast<node_ref_t>(compiled_.columns.size());
+    auto const leaf_offset =
+        static_cast<node_ref_t>(compiled_.leaves.size() - 1);
+    auto renumber = [&](node_ref_t node) -> node_ref_t {
+      if (!(node & tree::leaf_bit)) return node + node_offset;
+      if (node == tree::leaf_bit) return node;
+      return node + leaf_offset;
+    };
+    auto const threshold_offsets =
+        [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+          return std::array{static_cast<std::uint32_t>(
+              std::get<std::vector<
+                  typename tree::template observation_column_type<Columns>>>(
+                  compiled_.thresholds)
+                  .size())...};
+        }(std::make_index_sequence<observation_size>{});
+
+    roots_.push_back(renumber(compiled.root));
+    for (std::size_t node = 0; node < compiled.columns.size(); ++node) {
+      auto const column = compiled.columns[node];
+      compiled_.columns.push_back(column);
+      compiled_.threshold_indices.push_back(compiled.threshold_indices[node] +
+                                            threshold_offsets[column]);
+      compiled_.true_paths.push_back(renumber(compiled.true_paths[node]));
+      compiled_.false_paths.push_back(renumber(compiled.false_paths[node]));
+      compiled_.value_set_sizes.push_back(compiled.value_set_sizes[node]);
+    }
+    [&]<std::size_t... Types>(std::index_sequence<Types...>) {
+      (std::get<Types>(compiled_.thresholds)
+           .insert(std::get<Types>(compiled_.thresholds).end(),
+                   std::get<Types>(compiled.thresholds).begin(),
+                   std::get<Types>(compiled.thresholds).end()),
+       ...);
+    }(std::make_index_sequence<
+        std::tuple_size_v<typename tree::thresholds_t>>{});
+    compiled_.leaves.insert(compiled_.leaves.end(),
+                            compiled.leaves.begin() + 1,
+                            compiled.leaves.end());
+  }
+
+  // The dense leaf counts over the forest's predict values, the votes (each
+  // leaf's counts divided by their total and the tree count) and the
+  // missing value tables.
+  void finish(classes_t const& classes) {
+    auto const class_count = classes.predict_values.size();
+    compiled_.leaf_class_counts.assign(compiled_.leaves.size() * class_count,
+                                       0.0);
+    leaf_votes_.assign(compiled_.leaves.size() * class_count, 0.0);
+    for (std::size_t leaf = 0; leaf < compiled_.leaves.size(); ++leaf) {
+      auto const row = leaf * class_count;
+      for (auto const& [predict_value, count] : compiled_.leaves[leaf])
+        compiled_.leaf_class_counts[row + classes.id(predict_value)] = count;
+      auto const total = tree::result_counts_total(compiled_.leaves[leaf]);
+      if (total > 0.0)
+        for (std::size_t id = 0; id < class_count; ++id)
+          leaf_votes_[row + id] =
+              compiled_.leaf_class_counts[row + id] /
+              (total * static_cast<double>(roots_.size()));
+    }
+    tree::compile_missing_tables(compiled_);
+  }
+
+  void add_votes(std::size_t leaf, std::span<double> votes) const {
+    auto const class_count = predict_values().size();
+    auto const leaf_votes =
+        std::span{leaf_votes_}.subspan(leaf * class_count, class_count);
+    std::ranges::transform(leaf_votes, votes.first(class_count),
+                           votes.begin(), std::plus<>{});
+  }
+
+  compiled_tree_t compiled_;
+  std::vector<node_ref_t> roots_;
+  std::vector<double> leaf_votes_;
+};
+
+}  // namespace bit_factory::ml
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <bit>
+#include <bit_factory/ml/dictionary.hpp>
+#include <bit_factory/ml/model_file.hpp>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace bit_factory::ml {
+
+// A model lowered for serving, e.g. from a tree of any_decision_tree,
+// whose classify pays a type erased observation access and a virtual
+// take_true_path per node. The schema gives every observation column a
+// kind; a query holds one 64 bit cell per column: bools as 0 and 1,
+// integers as they are, reals as their bits and strings as their id in
+// strings, so unknown strings equal no threshold. Nodes store their
+// thresholds as cells in flat arrays next to a test_t, and take_true_path
+// is a switch on it. Leaf 0 is the empty result, reached for missing
+// values.
+struct lowered_tree_t {
+  using cell_t = std::int64_t;
+  using query_t = std::optional<cell_t>;
+  enum class test_t : std::uint8_t {
+    equal,
+    not_equal,
+    integer_greater_equal,
+    real_greater_equal,
+    real_equal,
+    real_not_equal
+  };
+
+  std::vector<model_file::tag_t> schema;
+  std::vector<std::uint32_t> columns;
+  std::vector<test_t> tests;
+  std::vector<cell_t> thresholds;
+  std::vector<std::uint32_t> true_paths, false_paths;
+  std::uint32_t root = model_file::leaf_bit;
+  dictionary_t strings;
+  std::vector<model_file::scalar_t> predict_values;
+  std::vector<double> leaf_class_counts;
+
+  [[nodiscard]] std::size_t class_count() const {
+    return predict_values.size();
+  }
+  [[nodiscard]] std::span<double const> class_counts(std::size_t leaf) const {
+    return std::span{leaf_class_counts}.subspan(leaf * class_count(),
+                                                class_count());
+  }
+
+  // The cell of value in column. Integers may be queried in real columns;
+  // other kinds have to match the schema, or std::invalid_argument is
+  // thrown.
+  [[nodiscard]] cell_t encode(std::size_t column,
+                              model_file::scalar_view_t const& value) const {
+    if (auto const cell = to_cell(schema.at(column), value, strings)) {
+      return *cell;
+    }
+    throw std::invalid_argument("lowered_tree_t: value does not match the "
+                                "schema of column " +
+                                std::to_string(column));
+  }
+
+  // Encodes a tuple or array of optionals, in column order, as the
+  // observation_t of the tuple and array sheets.
+  template <typename Observation>
+  [[nodiscard]] std::vector<query_t> encode(
+      Observation const& observation) const {
+    constexpr auto size = std::tuple_size_v<Observation>;
+    if (size > schema.size())
+      throw std::out_of_range("lowered_tree_t: observation wider than schema");
+    std::vector<query_t> query(schema.size());
+    [&]<std::size_t... Columns>(std::index_sequence<Columns...>) {
+      (
+          [&] {
+            if (auto const& value = std::get<Columns>(observation))
+              query[Columns] =
+                  encode(Columns, model_file::to_scalar_view(*value));
+          }(),
+          ...);
+    }(std::make_index_sequence<size>{});
+    return query;
+  }
+
+  [[nodiscard]] bool take_true_path(std::uint32_t node, cell_t query) const {
+    auto const threshold = thresholds[node];
+    switch (tests[node]) {
+      case test_t::equal:
+        return query == threshold;
+      case test_t::not_equal:
+        return query != threshold;
+      case test_t::integer_greater_equal:
+        return query >= threshold;
+      case test_t::real_greater_equal:
+        return std::bit_cast<double>(query) >= std::bit_cast<double>(threshold);
+      case test_t::real_equal:
+        return std::bit_cast<double>(query) == std::bit_cast<double>(threshold);
+      case test_t::real_not_equal:
+        return std::bit_cast<double>(query) != std::bit_cast<double>(threshold);
+    }
+    return false;
+  }
+
+  [[nodiscard]] std::size_t classify_leaf(
+      std::span<query_t const> query) const {
+    if (query.size() < schema.size())
+      throw std::out_of_range("lowered_tree_t: query narrower than schema");
+    return classify_leaf([&](std::size_t column) { return query[column]; });
+  }
+
+  // Asks cell_of for the query_t of a column only when a node on the path
+  // tests it, so the other columns are never read or encoded.
+  template <std::invocable<std::size_t> CellOf>
+  [[nodiscard]] std::size_t classify_leaf(CellOf const& cell_of) const {
+    auto node = root;
+    while (!model_file::model_view::is_leaf(node)) {
+      query_t const cell = cell_of(columns[node]);
+      if (!cell) return 0;
+      node = take_true_path(node, *cell) ? true_paths[node] : false_paths[node];
+    }
+    return model_file::model_view::leaf(node);
+  }
+
+  [[nodiscard]] std::span<double const> classify(
+      std::span<query_t const> query) const {
+    return class_counts(classify_leaf(query));
+  }
+
+  // The cell of value in a column of kind tag, none if the kinds differ.
+  [[nodiscard]] static std::optional<cell_t> to_cell(
+      model_file::tag_t tag, model_file::scalar_view_t const& value,
+      dictionary_t const& strings) {
+    return std::visit(
+        [&]<typename V>(V const& v) -> std::optional<cell_t> {
+          using model_file::tag_t;
+          if constexpr (std::same_as<V, bool>) {
+            if (tag == tag_t::boolean) return v ? 1 : 0;
+          } else if constexpr (std::same_as<V, std::int64_t>) {
+            if (tag == tag_t::integer) return v;
+            if (tag == tag_t::real)
+              return std::bit_cast<cell_t>(static_cast<double>(v));
+          } else if constexpr (std::same_as<V, double>) {
+            if (tag == tag_t::real) return std::bit_cast<cell_t>(v);
+          } else {
+            if (tag == tag_t::string) return strings.find(v).id;
+          }
+          return {};
+        },
+        value);
+  }
+};
+
+// Lowers model for the observation columns of schema. Throws
+// std::invalid_argument if a threshold does not match the kind of its
+// column or a column is not in schema.
+[[nodiscard]] inline lowered_tree_t lower(
+    model_file::model_view const& model,
+    std::vector<model_file::tag_t> schema) {
+  using model_file::op_t;
+  using model_file::tag_t;
+  using test_t = lowered_tree_t::test_t;
+  lowered_tree_t lowered{.schema = std::move(schema),
+                         .columns = {},
+                         .tests = {},
+                         .thresholds = {},
+                         .true_paths = {},
+                         .false_paths = {},
+                         .root = model.root(),
+                         .strings = {},
+                         .predict_values = {},
+                         .leaf_class_counts = {}};
+
+  std::vector<std::string> strings;
+  for (std::uint32_t node = 0; node < model.node_count(); ++node) {
+    auto const threshold = model.threshold(node);
+    if (auto const* string = std::get_if<std::string_view>(&threshold))
+      strings.emplace_back(*string);
+  }
+  lowered.strings = dictionary_t{std::move(strings)};
+
+  for (std::uint32_t node = 0; node < model.node_count(); ++node) {
+    auto const column = model.column(node);
+    if (column >= lowered.schema.size())
+      throw std::invalid_argument("lower: column " + std::to_string(column) +
+                                  " not in schema");
+    auto const tag = lowered.schema[column];
+    auto const op = model.op(node);
+    auto const threshold =
+        lowered_tree_t::to_cell(tag, model.threshold(node), lowered.strings);
+    if (!threshold || (tag == tag_t::string && op == op_t::greater_equal))
+      throw std::invalid_argument("lower: threshold of node " +
+                                  std::to_string(node) +
+                                  " does not match the schema");
+    auto const test =
+        tag == tag_t::real
+            ? (op == op_t::greater_equal ? test_t::real_greater_equal
+               : op == op_t::equal       ? test_t::real_equal
+                                         : test_t::real_not_equal)
+        : op == op_t::greater_equal ? test_t::integer_greater_equal
+        : op == op_t::equal         ? test_t::equal
+                                    : test_t::not_equal;
+    lowered.columns.push_back(static_cast<std::uint32_t>(column));
+    lowered.tests.push_back(test);
+    lowered.thresholds.push_back(*threshold);
+    lowered.true_paths.push_back(model.true_path(node));
+    lowered.false_paths.push_back(model.false_path(node));
+  }
+
+  for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id)
+    lowered.predict_values.push_back(std::visit(
+        []<typename V>(V const& v) -> model_file::scalar_t {
+          if constexpr (std::same_as<V, std::string_view>)
+            return std::string(v);
+          else
+            return v;
+        },
+        model.predict_value(class_id)));
+  lowered.leaf_class_counts.reserve(model.leaf_count() * model.class_count());
+  for (std::size_t leaf = 0; leaf < model.leaf_count(); ++leaf)
+    for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id)
+      lowered.leaf_class_counts.push_back(model.leaf_count(leaf, class_id));
+  return lowered;
+}
+
+[[nodiscard]] inline lowered_tree_t lower(
+    model_file::model_t const& model, std::vector<model_file::tag_t> schema) {
+  auto const bytes = model_file::serialize(model);
+  return lower(model_file::model_view{bytes}, std::move(schema));
+}
+
+}  // namespace bit_factory::ml
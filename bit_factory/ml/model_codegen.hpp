@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <bit_factory/ml/model_file.hpp>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+
+// Emits a model as a self contained C++ header: the leaf table as constexpr
+// arrays and classify_leaf as nested ifs over the observation, so the
+// compiler can inline and branch optimize the tree. The observation is
+// anything std::get<I> reads optionals from in column order, as the
+// observation_t of tulpe_sheet, array_sheet and column_sheet and the
+// observation_tuple_t of any_decision_tree. decision_tree_codegen runs this
+// on a model file; cmake/DecisionTreeCodegen.cmake runs that at build time.
+namespace bit_factory::ml::model_file {
+
+namespace detail {
+
+template <typename N>
+[[nodiscard]] std::string to_chars(N number) {
+  std::array<char, 32> buffer;
+  auto const end = std::to_chars(buffer.begin(), buffer.end(), number).ptr;
+  return {buffer.begin(), end};
+}
+
+[[nodiscard]] inline std::string cpp_literal(scalar_view_t const& value) {
+  return std::visit(
+      []<typename V>(V const& v) -> std::string {
+        if constexpr (std::same_as<V, bool>) {
+          return v ? "true" : "false";
+        } else if constexpr (std::same_as<V, std::int64_t>) {
+          if (v == std::numeric_limits<std::int64_t>::min())
+            return "(-9223372036854775807 - 1)";
+          return to_chars(v);
+        } else if constexpr (std::same_as<V, double>) {
+          if (std::isnan(v)) return "std::numeric_limits<double>::quiet_NaN()";
+          if (std::isinf(v))
+            return v > 0 ? "std::numeric_limits<double>::infinity()"
+                         : "-std::numeric_limits<double>::infinity()";
+          auto literal = to_chars(v);
+          if (literal.find_first_of(".e") == std::string::npos)
+            literal += ".0";
+          return literal;
+        } else {
+          std::string literal = "std::string_view{\"";
+          for (auto c : v) {
+            if (c == '"' || c == '\\') {
+              literal += {'\\', c};
+            } else if (c >= ' ' && c <= '~') {
+              literal += c;
+            } else {
+              // three digit octal escapes end unambiguously
+              literal += '\\';
+              for (auto const shift : {6, 3, 0})
+                literal += static_cast<char>(
+                    '0' + ((static_cast<unsigned char>(c) >> shift) & 7));
+            }
+          }
+          return literal + "\"}";
+        }
+      },
+      value);
+}
+
+[[nodiscard]] inline std::string_view cpp_type(scalar_view_t const& value) {
+  static constexpr std::string_view types[] = {"bool", "std::int64_t",
+                                               "double", "std::string_view"};
+  return types[value.index()];
+}
+
+[[nodiscard]] inline std::string_view cpp_op(op_t op) {
+  switch (op) {
+    case op_t::greater_equal:
+      return ">=";
+    case op_t::not_equal:
+      return "!=";
+    default:
+      return "==";
+  }
+}
+
+inline void generate_node(model_view const& model, std::ostream& os,
+                          std::uint32_t node, std::size_t depth) {
+  std::string const indent(2 * depth, ' ');
+  if (model_view::is_leaf(node)) {
+    os << indent << "return " << model_view::leaf(node) << ";\n";
+    return;
+  }
+  auto const query =
+      "get<" + std::to_string(model.column(node)) + ">(observation)";
+  os << indent << "if (!" << query << ") return 0;\n";
+  os << indent << "if (*" << query << ' ' << cpp_op(model.op(node)) << ' '
+     << cpp_literal(model.threshold(node)) << ") {\n";
+  generate_node(model, os, model.true_path(node), depth + 1);
+  os << indent << "} else {\n";
+  generate_node(model, os, model.false_path(node), depth + 1);
+  os << indent << "}\n";
+}
+
+}  // namespace detail
+
+// Writes the header for model into os, its declarations in name_space.
+// Throws std::invalid_argument for predict values of different kinds.
+inline void generate_header(model_view const& model, std::ostream& os,
+                            std::string_view name_space) {
+  std::string_view predict_type = "std::string_view";
+  for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id) {
+    auto const type = detail::cpp_type(model.predict_value(class_id));
+    if (class_id > 0 && type != predict_type)
+      throw std::invalid_argument(
+          "generate_header: predict values of different kinds");
+    predict_type = type;
+  }
+
+  os << "// Generated from a decision tree model file, do not edit.\n"
+        "#pragma once\n"
+        "\n"
+        "#include <array>\n"
+        "#include <cstddef>\n"
+        "#include <cstdint>\n"
+        "#include <limits>\n"
+        "#include <string_view>\n"
+        "#include <tuple>\n"
+        "\n"
+        "namespace "
+     << name_space << " {\n\n";
+  os << "inline constexpr std::size_t class_count = " << model.class_count()
+     << ";\n";
+  os << "inline constexpr std::size_t leaf_count = " << model.leaf_count()
+     << ";\n\n";
+
+  os << "inline constexpr std::array<" << predict_type
+     << ", class_count> predict_values{";
+  for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id)
+    os << (class_id ? ", " : "")
+       << detail::cpp_literal(model.predict_value(class_id));
+  os << "};\n\n";
+
+  os << "// One row of class counts per leaf, leaf 0 is the empty result.\n"
+        "inline constexpr std::array<std::array<double, class_count>, "
+        "leaf_count>\n"
+        "    leaf_class_counts{{\n";
+  for (std::size_t leaf = 0; leaf < model.leaf_count(); ++leaf) {
+    os << "        {";
+    for (std::size_t class_id = 0; class_id < model.class_count(); ++class_id)
+      os << (class_id ? ", " : "")
+         << detail::cpp_literal(model.leaf_count(leaf, class_id));
+    os << "},\n";
+  }
+  os << "    }};\n\n";
+
+  os << "// Leaf of observation, 0 if a value on its path is missing.\n"
+        "template <typename Observation>\n"
+        "[[nodiscard]] constexpr std::size_t classify_leaf(\n"
+        "    [[maybe_unused]] Observation const& observation) {\n"
+        "  using std::get;\n";
+  detail::generate_node(model, os, model.root(), 1);
+  os << "}\n\n";
+
+  os << "template <typename Observation>\n"
+        "[[nodiscard]] constexpr std::array<double, class_count> const& "
+        "classify(\n"
+        "    Observation const& observation) {\n"
+        "  return leaf_class_counts[classify_leaf(observation)];\n"
+        "}\n\n";
+  os << "}  // namespace " << name_space << "\n";
+}
+
+inline void generate_header(model_t const& model, std::ostream& os,
+                            std::string_view name_space) {
+  auto const bytes = serialize(model);
+  generate_header(model_view{bytes}, os, name_space);
+}
+
+}  // namespace bit_factory::ml::model_file
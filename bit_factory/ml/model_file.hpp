@@ -0,0 +1,541 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary model format shared by decision_tree<Sheet> and any_decision_tree.
+// Version 1 layout, all numbers little endian:
+//
+//   header       magic "BFDT", u32 version, u32 root, u32 node count,
+//                u32 leaf count, u32 class count, u64 string bytes
+//   classes      class count scalars, the predict values
+//   nodes        node count records: u32 column, u32 op, u32 true path,
+//                u32 false path, scalar threshold
+//   leaf counts  leaf count * class count f64, one row per leaf
+//   strings      the bytes of all string scalars
+//
+// A scalar is u32 tag, u32 string length, u64 payload: the bool, the
+// int64, the bits of the double or the offset of the string. Node
+// references with leaf_bit set index the leaves, leaf 0 is the empty
+// result reached for missing values. model_view classifies straight from
+// the bytes, mapped_model maps a file for it. Nodes are numbered depth
+// first, so the children of a node are leaves or nodes after it.
+namespace bit_factory::ml::model_file {
+
+inline constexpr std::array<char, 4> magic{'B', 'F', 'D', 'T'};
+inline constexpr std::uint32_t version = 1;
+inline constexpr std::uint32_t leaf_bit = std::uint32_t{1} << 31;
+
+enum class tag_t : std::uint32_t {
+  boolean = 1,
+  integer = 2,
+  real = 3,
+  string = 4
+};
+enum class op_t : std::uint32_t {
+  greater_equal = 0,
+  equal = 1,
+  not_equal = 2
+};
+
+using scalar_t = std::variant<bool, std::int64_t, double, std::string>;
+using scalar_view_t =
+    std::variant<bool, std::int64_t, double, std::string_view>;
+
+// Values a model file can store: bool, arithmetic and string values.
+template <typename V>
+inline constexpr bool is_scalar =
+    std::is_arithmetic_v<V> || std::convertible_to<V const&, std::string_view>;
+
+template <typename V>
+[[nodiscard]] constexpr bool above_int64(V value) {
+  if constexpr (std::is_unsigned_v<V> && sizeof(V) >= sizeof(std::int64_t))
+    return value > V{std::numeric_limits<std::int64_t>::max()};
+  else
+    return false;
+}
+
+// Unsigned values above the int64 range have no exact scalar, so they are
+// rejected instead of stored as a different threshold.
+template <typename V>
+[[nodiscard]] scalar_t to_scalar(V const& value) {
+  if constexpr (std::same_as<V, bool>) {
+    return value;
+  } else if constexpr (std::is_integral_v<V>) {
+    if (above_int64(value))
+      throw std::out_of_range("model file: integer outside the int64 range");
+    return static_cast<std::int64_t>(value);
+  } else if constexpr (std::is_floating_point_v<V>) {
+    return static_cast<double>(value);
+  } else {
+    static_assert(std::convertible_to<V const&, std::string_view>,
+                  "model files store bool, arithmetic and string values");
+    return std::string{std::string_view{value}};
+  }
+}
+
+// Query values above the int64 range compare as double, which keeps them
+// at or above every stored threshold.
+template <typename V>
+[[nodiscard]] scalar_view_t to_scalar_view(V const& value) {
+  if constexpr (std::same_as<V, bool>) {
+    return value;
+  } else if constexpr (std::is_integral_v<V>) {
+    if (above_int64(value)) return static_cast<double>(value);
+    return static_cast<std::int64_t>(value);
+  } else if constexpr (std::is_floating_point_v<V>) {
+    return static_cast<double>(value);
+  } else {
+    static_assert(std::convertible_to<V const&, std::string_view>,
+                  "model files store bool, arithmetic and string values");
+    return std::string_view{value};
+  }
+}
+
+[[nodiscard]] inline scalar_view_t to_scalar_view(scalar_t const& value) {
+  return std::visit([](auto const& v) -> scalar_view_t { return v; }, value);
+}
+[[nodiscard]] inline scalar_view_t to_scalar_view(scalar_view_t value) {
+  return value;
+}
+
+template <typename V>
+[[nodiscard]] V from_scalar(scalar_view_t const& value) {
+  return std::visit(
+      [](auto const& v) -> V {
+        using S = std::decay_t<decltype(v)>;
+        if constexpr (std::same_as<S, std::string_view>) {
+          if constexpr (std::constructible_from<V, std::string_view>)
+            return V(v);
+          else
+            throw std::runtime_error("model file: string for a number");
+        } else {
+          if constexpr (std::is_arithmetic_v<V>)
+            return static_cast<V>(v);
+          else
+            throw std::runtime_error("model file: number for a string");
+        }
+      },
+      value);
+}
+
+struct node_t {
+  std::uint32_t column = 0;
+  op_t op = op_t::equal;
+  std::uint32_t true_path = leaf_bit, false_path = leaf_bit;
+  scalar_t threshold;
+};
+
+// In memory form of a model, written by serialize and save.
+struct model_t {
+  std::vector<scalar_t> predict_values;
+  std::vector<node_t> nodes;
+  std::size_t leaf_count = 0;
+  std::vector<double> leaf_class_counts;
+  std::uint32_t root = leaf_bit;
+};
+
+namespace detail {
+
+inline constexpr std::size_t header_size = 32;
+inline constexpr std::size_t scalar_size = 16;
+inline constexpr std::size_t node_size = 16 + scalar_size;
+
+template <std::unsigned_integral U>
+void put(std::vector<std::byte>& bytes, U value) {
+  if constexpr (std::endian::native == std::endian::big)
+    value = std::byteswap(value);
+  auto const offset = bytes.size();
+  bytes.resize(offset + sizeof(U));
+  std::memcpy(bytes.data() + offset, &value, sizeof(U));
+}
+
+template <std::unsigned_integral U>
+[[nodiscard]] U get(std::span<std::byte const> bytes, std::size_t offset) {
+  U value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(U));
+  if constexpr (std::endian::native == std::endian::big)
+    value = std::byteswap(value);
+  return value;
+}
+
+inline void put_scalar(std::vector<std::byte>& bytes, std::string& strings,
+                       scalar_t const& value) {
+  std::visit(
+      [&]<typename V>(V const& v) {
+        if constexpr (std::same_as<V, bool>) {
+          put(bytes, static_cast<std::uint32_t>(tag_t::boolean));
+          put(bytes, std::uint32_t{0});
+          put(bytes, std::uint64_t{v});
+        } else if constexpr (std::same_as<V, std::int64_t>) {
+          put(bytes, static_cast<std::uint32_t>(tag_t::integer));
+          put(bytes, std::uint32_t{0});
+          put(bytes, static_cast<std::uint64_t>(v));
+        } else if constexpr (std::same_as<V, double>) {
+          put(bytes, static_cast<std::uint32_t>(tag_t::real));
+          put(bytes, std::uint32_t{0});
+          put(bytes, std::bit_cast<std::uint64_t>(v));
+        } else {
+          put(bytes, static_cast<std::uint32_t>(tag_t::string));
+          put(bytes, static_cast<std::uint32_t>(v.size()));
+          put(bytes, std::uint64_t{strings.size()});
+          strings += v;
+        }
+      },
+      value);
+}
+
+}  // namespace detail
+
+[[nodiscard]] inline std::vector<std::byte> serialize(model_t const& model) {
+  auto const class_count = model.predict_values.size();
+  if (model.leaf_class_counts.size() != model.leaf_count * class_count)
+    throw std::invalid_argument("serialize: leaf_class_counts size");
+  std::vector<std::byte> bytes;
+  std::string strings;
+  for (auto c : magic) bytes.push_back(static_cast<std::byte>(c));
+  detail::put(bytes, version);
+  detail::put(bytes, model.root);
+  detail::put(bytes, static_cast<std::uint32_t>(model.nodes.size()));
+  detail::put(bytes, static_cast<std::uint32_t>(model.leaf_count));
+  detail::put(bytes, static_cast<std::uint32_t>(class_count));
+  auto const string_bytes_offset = bytes.size();
+  detail::put(bytes, std::uint64_t{0});
+  for (auto const& predict_value : model.predict_values)
+    detail::put_scalar(bytes, strings, predict_value);
+  for (auto const& node : model.nodes) {
+    detail::put(bytes, node.column);
+    detail::put(bytes, static_cast<std::uint32_t>(node.op));
+    detail::put(bytes, node.true_path);
+    detail::put(bytes, node.false_path);
+    detail::put_scalar(bytes, strings, node.threshold);
+  }
+  for (auto count : model.leaf_class_counts)
+    detail::put(bytes, std::bit_cast<std::uint64_t>(count));
+  for (auto c : strings) bytes.push_back(static_cast<std::byte>(c));
+  std::uint64_t string_bytes = strings.size();
+  if constexpr (std::endian::native == std::endian::big)
+    string_bytes = std::byteswap(string_bytes);
+  std::memcpy(bytes.data() + string_bytes_offset, &string_bytes,
+              sizeof(string_bytes));
+  return bytes;
+}
+
+inline void save(std::filesystem::path const& path, model_t const& model) {
+  auto const bytes = serialize(model);
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  file.write(reinterpret_cast<char const*>(bytes.data()),  // NOLINT
+             static_cast<std::streamsize>(bytes.size()));
+  if (!file) throw std::runtime_error("save: cannot write " + path.string());
+}
+
+// Read only view of a serialized model. The constructor validates the
+// header, the section sizes, all references, ops and values once, so
+// classification of untrusted bytes reads only within them and ends;
+// classification then reads the bytes directly.
+class model_view {
+ public:
+  explicit model_view(std::span<std::byte const> bytes) : bytes_(bytes) {
+    if (bytes_.size() < detail::header_size ||
+        !std::equal(magic.begin(), magic.end(), bytes_.begin(),
+                    [](char c, std::byte b) {
+                      return static_cast<std::byte>(c) == b;
+                    }))
+      throw std::runtime_error("model file: bad magic");
+    if (detail::get<std::uint32_t>(bytes_, 4) != version)
+      throw std::runtime_error("model file: unsupported version");
+    root_ = detail::get<std::uint32_t>(bytes_, 8);
+    node_count_ = detail::get<std::uint32_t>(bytes_, 12);
+    leaf_count_ = detail::get<std::uint32_t>(bytes_, 16);
+    class_count_ = detail::get<std::uint32_t>(bytes_, 20);
+    auto const string_bytes = detail::get<std::uint64_t>(bytes_, 24);
+    // Each count is compared with the bytes left before it is multiplied.
+    auto remaining = bytes_.size() - detail::header_size;
+    auto section = [&](std::size_t count, std::size_t record_size) {
+      if (record_size != 0 && count > remaining / record_size)
+        throw std::runtime_error("model file: bad size");
+      auto const offset = bytes_.size() - remaining;
+      remaining -= count * record_size;
+      return offset;
+    };
+    if (leaf_count_ == 0) throw std::runtime_error("model file: bad size");
+    classes_ = section(class_count_, detail::scalar_size);
+    nodes_ = section(node_count_, detail::node_size);
+    leaves_ = section(leaf_count_, class_count_ * sizeof(double));
+    strings_ = bytes_.size() - remaining;
+    if (string_bytes != remaining)
+      throw std::runtime_error("model file: bad size");
+    check_reference(root_, 0);
+    for (std::size_t id = 0; id < class_count_; ++id)
+      check_scalar(classes_ + id * detail::scalar_size);
+    for (std::uint32_t node = 0; node < node_count_; ++node) {
+      if (detail::get<std::uint32_t>(bytes_, node_offset(node) + 4) >
+          static_cast<std::uint32_t>(op_t::not_equal))
+        throw std::runtime_error("model file: bad op");
+      check_reference(true_path(node), node + 1);
+      check_reference(false_path(node), node + 1);
+      check_scalar(node_offset(node) + 16);
+    }
+  }
+
+  [[nodiscard]] std::uint32_t root() const { return root_; }
+  [[nodiscard]] std::size_t node_count() const { return node_count_; }
+  [[nodiscard]] std::size_t leaf_count() const { return leaf_count_; }
+  [[nodiscard]] std::size_t class_count() const { return class_count_; }
+
+  [[nodiscard]] static bool is_leaf(std::uint32_t node) {
+    return (node & leaf_bit) != 0;
+  }
+  [[nodiscard]] static std::size_t leaf(std::uint32_t node) {
+    return node & ~leaf_bit;
+  }
+  [[nodiscard]] std::size_t column(std::uint32_t node) const {
+    return detail::get<std::uint32_t>(bytes_, node_offset(node));
+  }
+  [[nodiscard]] op_t op(std::uint32_t node) const {
+    return static_cast<op_t>(
+        detail::get<std::uint32_t>(bytes_, node_offset(node) + 4));
+  }
+  [[nodiscard]] std::uint32_t true_path(std::uint32_t node) const {
+    return detail::get<std::uint32_t>(bytes_, node_offset(node) + 8);
+  }
+  [[nodiscard]] std::uint32_t false_path(std::uint32_t node) const {
+    return detail::get<std::uint32_t>(bytes_, node_offset(node) + 12);
+  }
+  [[nodiscard]] scalar_view_t threshold(std::uint32_t node) const {
+    return scalar(node_offset(node) + 16);
+  }
+  [[nodiscard]] scalar_view_t predict_value(std::size_t class_id) const {
+    return scalar(classes_ + class_id * detail::scalar_size);
+  }
+  [[nodiscard]] double leaf_count(std::size_t leaf,
+                                  std::size_t class_id) const {
+    return std::bit_cast<double>(detail::get<std::uint64_t>(
+        bytes_,
+        leaves_ + (leaf * class_count_ + class_id) * sizeof(double)));
+  }
+
+  // Numbers compare by value across integer and real, other values only
+  // with their own kind.
+  [[nodiscard]] bool take_true_path(std::uint32_t node,
+                                    scalar_view_t const& query) const {
+    auto const threshold_value = threshold(node);
+    auto const equal = std::visit(
+        []<typename Q, typename T>(Q const& q, T const& t) {
+          if constexpr (std::same_as<Q, T>)
+            return q == t;
+          else if constexpr (is_number<Q> && is_number<T>)
+            return static_cast<double>(q) == static_cast<double>(t);
+          else
+            return false;
+        },
+        query, threshold_value);
+    switch (op(node)) {
+      case op_t::greater_equal:
+        return std::visit(
+            []<typename Q, typename T>(Q const& q, T const& t) {
+              if constexpr (std::same_as<Q, T>)
+                return q >= t;
+              else if constexpr (is_number<Q> && is_number<T>)
+                return static_cast<double>(q) >= static_cast<double>(t);
+              else
+                return false;
+            },
+            query, threshold_value);
+      case op_t::not_equal:
+        return !equal;
+      default:
+        return equal;
+    }
+  }
+
+  // Walks from the root; get_query(column) returns the query value of a
+  // column as an optional of something to_scalar_view accepts. A missing
+  // value ends the walk in leaf 0.
+  [[nodiscard]] std::size_t classify_leaf(auto get_query) const {
+    auto node = root_;
+    while (!is_leaf(node)) {
+      auto const query = get_query(column(node));
+      if (!query) return 0;
+      node = take_true_path(node, to_scalar_view(*query)) ? true_path(node)
+                                                          : false_path(node);
+    }
+    return leaf(node);
+  }
+
+ private:
+  template <typename V>
+  static constexpr bool is_number =
+      std::same_as<V, std::int64_t> || std::same_as<V, double>;
+
+  [[nodiscard]] std::size_t node_offset(std::uint32_t node) const {
+    return nodes_ + std::size_t{node} * detail::node_size;
+  }
+
+  [[nodiscard]] scalar_view_t scalar(std::size_t offset) const {
+    auto const payload = detail::get<std::uint64_t>(bytes_, offset + 8);
+    switch (static_cast<tag_t>(detail::get<std::uint32_t>(bytes_, offset))) {
+      case tag_t::boolean:
+        return payload != 0;
+      case tag_t::integer:
+        return static_cast<std::int64_t>(payload);
+      case tag_t::real:
+        return std::bit_cast<double>(payload);
+      default:
+        return std::string_view{
+            reinterpret_cast<char const*>(  // NOLINT
+                bytes_.data() + strings_ + payload),
+            detail::get<std::uint32_t>(bytes_, offset + 4)};
+    }
+  }
+
+  // Nodes referenced have to be first or later, so walks end.
+  void check_reference(std::uint32_t node, std::size_t first) const {
+    if (is_leaf(node) ? leaf(node) >= leaf_count_
+                      : node < first || node >= node_count_)
+      throw std::runtime_error("model file: bad node reference");
+  }
+  void check_scalar(std::size_t offset) const {
+    auto const tag = detail::get<std::uint32_t>(bytes_, offset);
+    if (tag < static_cast<std::uint32_t>(tag_t::boolean) ||
+        tag > static_cast<std::uint32_t>(tag_t::string))
+      throw std::runtime_error("model file: bad value tag");
+    auto const string_bytes = bytes_.size() - strings_;
+    auto const payload = detail::get<std::uint64_t>(bytes_, offset + 8);
+    if (tag == static_cast<std::uint32_t>(tag_t::string) &&
+        (payload > string_bytes ||
+         detail::get<std::uint32_t>(bytes_, offset + 4) >
+             string_bytes - payload))
+      throw std::runtime_error("model file: bad string");
+  }
+
+  std::span<std::byte const> bytes_;
+  std::uint32_t root_ = leaf_bit;
+  std::size_t node_count_ = 0, leaf_count_ = 0, class_count_ = 0;
+  std::size_t classes_ = 0, nodes_ = 0, leaves_ = 0, strings_ = 0;
+};
+
+// Read only memory mapping of a whole file.
+class mapped_file {
+ public:
+  explicit mapped_file(std::filesystem::path const& path) {
+#if defined(_WIN32)
+    file_ = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) throw_last_error(path);
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file_, &size)) throw_last_error(path);
+    size_ = static_cast<std::size_t>(size.QuadPart);
+    if (size_ == 0) return;
+    mapping_ =
+        ::CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_) throw_last_error(path);
+    data_ = ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!data_) throw_last_error(path);
+#else
+    auto const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw_last_error(path);
+    struct ::stat status{};
+    if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+      size_ = static_cast<std::size_t>(status.st_size);
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+      if (data_ == MAP_FAILED) data_ = nullptr;
+    }
+    auto const error = errno;
+    ::close(fd);
+    if (!data_ && size_ > 0) {
+      errno = error;
+      throw_last_error(path);
+    }
+#endif
+  }
+  mapped_file(mapped_file const&) = delete;
+  mapped_file& operator=(mapped_file const&) = delete;
+  ~mapped_file() { release(); }
+
+  [[nodiscard]] std::span<std::byte const> bytes() const {
+    if (!data_) return {};
+    return {static_cast<std::byte const*>(data_), size_};
+  }
+
+ private:
+  void release() noexcept {
+#if defined(_WIN32)
+    if (data_) ::UnmapViewOfFile(data_);
+    if (mapping_) ::CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) ::CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_) ::munmap(data_, size_);
+#endif
+    data_ = nullptr;
+  }
+
+  [[noreturn]] void throw_last_error(std::filesystem::path const& path) {
+#if defined(_WIN32)
+    auto const error = static_cast<int>(::GetLastError());
+#else
+    auto const error = errno;
+#endif
+    release();
+    throw std::system_error(error, std::system_category(),
+                            "mapped_file: " + path.string());
+  }
+
+#if defined(_WIN32)
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#endif
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+// A model file mapped into memory. Processes mapping the same file share
+// its pages; nothing is copied onto the heap.
+class mapped_model {
+ public:
+  explicit mapped_model(std::filesystem::path const& path)
+      : file_(path), view_(file_.bytes()) {}
+
+  [[nodiscard]] model_view const& view() const { return view_; }
+
+ private:
+  mapped_file file_;
+  model_view view_;
+};
+
+}  // namespace bit_factory::ml::model_file
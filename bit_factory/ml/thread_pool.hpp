@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bit_factory::ml {
+
+// Work stealing pool for the opt-in parallel training and classification
+// paths. Every worker owns a deque: tasks submitted from a worker go to the
+// back of its own deque and are taken from there (newest first), idle
+// workers steal from the front of the others (oldest first). Tasks
+// submitted from outside the pool go to a shared queue. A thread waiting
+// for a task runs other tasks meanwhile, so tasks may wait for tasks they
+// submitted themselves.
+class thread_pool {
+ public:
+  explicit thread_pool(
+      std::size_t thread_count = std::thread::hardware_concurrency()) {
+    thread_count = std::max(thread_count, std::size_t{1});
+    for (std::size_t i = 0; i <= thread_count; ++i)
+      queues_.push_back(std::make_unique<queue_t>());
+    threads_.reserve(thread_count);
+    for (std::size_t i = 0; i < thread_count; ++i)
+      threads_.emplace_back([this, i] { work(i); });
+  }
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+  ~thread_pool() {
+    {
+      std::scoped_lock lock{sleep_mutex_};
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  [[nodiscard]] std::size_t size() const { return queues_.size() - 1; }
+
+  template <typename F>
+  [[nodiscard]] auto submit(F&& f) -> std::future<std::invoke_result_t<F&>> {
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F&>()>>(
+        std::forward<F>(f));
+    auto future = task->get_future();
+    {
+      std::scoped_lock lock{sleep_mutex_};
+      ++pending_;
+    }
+    {
+      auto& queue = *queues_[own_queue()];
+      std::scoped_lock lock{queue.mutex};
+      queue.tasks.emplace_back([task] { (*task)(); });
+    }
+    ready_.notify_one();
+    return future;
+  }
+
+  template <typename T>
+  [[nodiscard]] T get(std::future<T>& future) {
+    wait(future);
+    return future.get();
+  }
+
+  // Runs other tasks until future is ready. Leaves the result (or the
+  // exception) in the future, so it never throws.
+  template <typename T>
+  void wait(std::future<T> const& future) {
+    using namespace std::chrono_literals;
+    while (future.wait_for(0s) != std::future_status::ready) {
+      if (auto task = pop(own_queue()))
+        (*task)();
+      else
+        future.wait_for(100us);
+    }
+  }
+
+ private:
+  using task_t = std::function<void()>;
+  struct queue_t {
+    std::mutex mutex;
+    std::deque<task_t> tasks;
+  };
+
+  [[nodiscard]] std::size_t shared_queue() const { return queues_.size() - 1; }
+  [[nodiscard]] std::size_t own_queue() const {
+    return current_pool_ == this ? current_queue_ : shared_queue();
+  }
+
+  std::optional<task_t> take(std::size_t index, bool newest) {
+    auto& queue = *queues_[index];
+    std::scoped_lock lock{queue.mutex};
+    if (queue.tasks.empty()) return {};
+    std::optional<task_t> task;
+    if (newest) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    --pending_;
+    return task;
+  }
+
+  std::optional<task_t> pop(std::size_t own) {
+    if (auto task = take(own, own != shared_queue())) return task;
+    for (std::size_t i = 0; i < queues_.size(); ++i)
+      if (auto victim = (own + 1 + i) % queues_.size(); victim != own)
+        if (auto task = take(victim, false)) return task;
+    return {};
+  }
+
+  void work(std::size_t index) {
+    current_pool_ = this;
+    current_queue_ = index;
+    for (;;) {
+      if (auto task = pop(index)) {
+        (*task)();
+        continue;
+      }
+      std::unique_lock lock{sleep_mutex_};
+      ready_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+      if (stopping_ && pending_ == 0) return;
+    }
+  }
+
+  inline static thread_local thread_pool const* current_pool_ = nullptr;
+  inline static thread_local std::size_t current_queue_ = 0;
+
+  std::vector<std::unique_ptr<queue_t>> queues_;
+  std::mutex sleep_mutex_;
+  std::condition_variable ready_;
+  std::atomic<std::size_t> pending_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+// Waits for a future, or a container of futures, when leaving the scope
+// that submitted their tasks, so tasks referring to locals of that scope
+// finish before an exception unwinds it.
+template <typename Futures>
+class wait_guard {
+ public:
+  wait_guard(thread_pool& pool, Futures& futures)
+      : pool_{pool}, futures_{futures} {}
+  wait_guard(wait_guard const&) = delete;
+  wait_guard& operator=(wait_guard const&) = delete;
+  ~wait_guard() {
+    if constexpr (std::ranges::range<Futures>) {
+      for (auto const& future : futures_)
+        if (future.valid()) pool_.wait(future);
+    } else if (futures_.valid()) {
+      pool_.wait(futures_);
+    }
+  }
+
+ private:
+  thread_pool& pool_;
+  Futures& futures_;
+};
+
+// How build_tree uses a pool: the columns of nodes with at least
+// columns_cutoff rows are searched in parallel, the two subtrees of nodes
+// with at least subtrees_cutoff rows are built as separate tasks.
+struct parallel_build_t {
+  thread_pool& pool;
+  std::size_t columns_cutoff = 0;
+  std::size_t subtrees_cutoff = std::numeric_limits<std::size_t>::max();
+};
+
+}  // namespace bit_factory::ml
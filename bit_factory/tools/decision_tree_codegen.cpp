@@ -0,0 +1,33 @@
+// decision_tree_codegen <model file> <header> <namespace>
+//
+// Writes the model file as a header of nested ifs, see model_codegen.hpp.
+#include <bit_factory/ml/model_codegen.hpp>
+#include <bit_factory/ml/model_file.hpp>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <span>
+
+int main(int argc, char** argv) {
+  std::span const args{argv, static_cast<std::size_t>(argc)};
+  if (args.size() != 4) {
+    std::cerr << "usage: decision_tree_codegen <model file> <header> "
+                 "<namespace>\n";
+    return 2;
+  }
+  try {
+    bit_factory::ml::model_file::mapped_model const model{args[1]};
+    std::ofstream header{args[2], std::ios::trunc};
+    bit_factory::ml::model_file::generate_header(model.view(), header,
+                                                 args[3]);
+    header.close();
+    if (!header) {
+      std::cerr << "decision_tree_codegen: cannot write " << args[2] << "\n";
+      return 1;
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "decision_tree_codegen: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+# decision_tree_generate_header(<target> MODEL <model file> NAMESPACE <namespace>
+#                               [OUTPUT <header>])
+#
+# Runs decision_tree_codegen at build time to turn a model file written with
+# bit_factory::ml::model_file::save into a header of nested ifs, adds it to
+# <target> and puts its directory on the include path of <target>. The
+# header is regenerated when the model file changes. OUTPUT defaults to
+# decision_tree_generated/<namespace>.hpp in the current binary directory.
+# Defined when decision_tree_BUILD_CODEGEN is on, the default for top level
+# builds.
+function(decision_tree_generate_header target)
+  cmake_parse_arguments(PARSE_ARGV 1 arg "" "MODEL;NAMESPACE;OUTPUT" "")
+  if(NOT arg_MODEL OR NOT arg_NAMESPACE)
+    message(FATAL_ERROR "decision_tree_generate_header: MODEL and NAMESPACE are required")
+  endif()
+  if(NOT arg_OUTPUT)
+    set(arg_OUTPUT "${CMAKE_CURRENT_BINARY_DIR}/decision_tree_generated/${arg_NAMESPACE}.hpp")
+  endif()
+  cmake_path(ABSOLUTE_PATH arg_MODEL BASE_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}")
+  cmake_path(ABSOLUTE_PATH arg_OUTPUT BASE_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}")
+  cmake_path(GET arg_OUTPUT PARENT_PATH output_dir)
+
+  add_custom_command(
+    OUTPUT "${arg_OUTPUT}"
+    COMMAND "${CMAKE_COMMAND}" -E make_directory "${output_dir}"
+    COMMAND $<TARGET_FILE:decision_tree_codegen> "${arg_MODEL}" "${arg_OUTPUT}" "${arg_NAMESPACE}"
+    DEPENDS decision_tree_codegen "${arg_MODEL}"
+    COMMENT "Generating ${arg_OUTPUT} from ${arg_MODEL}"
+    VERBATIM)
+  target_sources(${target} PRIVATE "${arg_OUTPUT}")
+  target_include_directories(${target} PRIVATE "${output_dir}")
+endfunction()
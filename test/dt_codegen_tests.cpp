@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <bit_factory/ml/decision_tree.hpp>
+#include <bit_factory/ml/model_file.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <modulo_tree.hpp>
+#include <span>
+#include <vector>
+
+// modulo_tree.hpp is generated at build time by decision_tree_codegen from
+// models/modulo_tree.bfdt, see cmake/DecisionTreeCodegen.cmake.
+namespace {
+
+using decision_tree =
+    bit_factory::ml::decision_tree<bit_factory::ml::array_sheet<int, 3>>;
+
+// The rows models/modulo_tree.bfdt was trained on.
+decision_tree::rows_t modulo_samples() {
+  decision_tree::rows_t samples;
+  for (int i = 0; i < 300; ++i)
+    samples.push_back({{i % 7, i % 11, i % 5}, (i % 7 + i % 5) % 3});
+  return samples;
+}
+
+TEST_CASE("generated header matches its tree") {
+  using namespace bit_factory::ml;
+  auto const compiled =
+      decision_tree::compile(decision_tree::build_tree(modulo_samples()));
+
+  // The checked-in model is the tree build_tree trains today.
+  model_file::mapped_file const model{DECISION_TREE_TEST_MODEL};
+  CHECK(std::ranges::equal(
+      model.bytes(),
+      model_file::serialize(decision_tree::to_model(compiled))));
+
+  CHECK(modulo_tree::class_count == compiled.predict_values.size());
+  CHECK(std::ranges::equal(modulo_tree::predict_values,
+                           compiled.predict_values));
+
+  std::vector<decision_tree::observation_t> observations;
+  for (int i = 0; i < 200; ++i)
+    observations.push_back({i % 8, i % 12, i % 6});
+  observations[3][0].reset();
+  observations[4][1].reset();
+  observations[5][2].reset();
+  for (auto const& observation : observations) {
+    auto const leaf = decision_tree::classify_leaf(compiled, observation);
+    CHECK(modulo_tree::classify_leaf(observation) == leaf);
+    auto const class_count = compiled.predict_values.size();
+    CHECK(std::ranges::equal(
+        modulo_tree::classify(observation),
+        std::span{compiled.leaf_class_counts}.subspan(leaf * class_count,
+                                                      class_count)));
+  }
+}
+
+}  // namespace
@@ -8,7 +8,10 @@
 // #include <print>
 #include <algorithm>
 #include <concepts>
+#include <memory_resource>
 #include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 
@@ -38,6 +41,35 @@ const samples test_data{{"Slashdot", "France", true, 19, "None"},
                         {"(direct)", "New Zealand", false, 12, "None"},
                         {"(direct)", "UK", false, 21, "basic"}};
 
+// test_data with its string and int columns also stored contiguously.
+struct columnar_samples {
+  samples rows;
+  std::vector<std::string> referrers, locations;
+  std::vector<int> pages;
+
+  explicit columnar_samples(samples data) : rows(std::move(data)) {
+    for (auto const& [referrer, location, faq, page, service] : rows) {
+      referrers.push_back(referrer);
+      locations.push_back(location);
+      pages.push_back(page);
+    }
+  }
+};
+
+// test_data with pages viewed as float, which training keeps boxed.
+using boxed_sample = std::tuple<std::string, std::string, bool, float,
+                                std::string>;
+using boxed_samples = std::vector<boxed_sample>;
+
+// A row of test_data that counts the reads of its cells.
+struct counted_sample {
+  sample values;
+  std::size_t* reads = nullptr;
+
+  bool operator==(counted_sample const&) const = default;
+};
+using counted_samples = std::vector<counted_sample>;
+
 }  // namespace tuple_dt_smoke_test
 }  // namespace
 
@@ -71,6 +103,78 @@ ANY_MODEL_MAP((tuple_dt_smoke_test::samples),
   };
 };
 
+ANY_MODEL_MAP((tuple_dt_smoke_test::columnar_samples),
+              bit_factory::ml::any_decision_tree::sheet) {
+  static anyxx::any_forward_range<row<>, row<>> rows(
+      tuple_dt_smoke_test::columnar_samples const& self) {  // NOLINT
+    return self.rows;
+  };
+  static std::string column_header(
+      tuple_dt_smoke_test::columnar_samples const& self, std::size_t index) {
+    return sheet<>{self.rows}.column_header(index);
+  };
+  static std::size_t column_count(
+      [[maybe_unused]] tuple_dt_smoke_test::columnar_samples const& self) {
+    return std::tuple_size_v<tuple_dt_smoke_test::sample>;
+  };
+  static column_buffer_t column_buffer(
+      tuple_dt_smoke_test::columnar_samples const& self, std::size_t index) {
+    switch (index) {
+      case 0:
+        return std::span<std::string const>{self.referrers};
+      case 1:
+        return std::span<std::string const>{self.locations};
+      case 3:
+        return std::span<int const>{self.pages};
+      default:
+        return {};
+    }
+  };
+};
+
+ANY_MODEL_MAP((tuple_dt_smoke_test::boxed_samples),
+              bit_factory::ml::any_decision_tree::sheet) {
+  static anyxx::any_forward_range<row<>, row<>> rows(
+      tuple_dt_smoke_test::boxed_samples const& self) {  // NOLINT
+    return self;
+  };
+  static std::string column_header(
+      [[maybe_unused]] tuple_dt_smoke_test::boxed_samples const& self,
+      std::size_t index) {
+    return sheet<>{tuple_dt_smoke_test::test_data}.column_header(index);
+  };
+  static std::size_t column_count(
+      [[maybe_unused]] tuple_dt_smoke_test::boxed_samples const& self) {
+    return std::tuple_size_v<tuple_dt_smoke_test::boxed_sample>;
+  };
+};
+
+ANY_MODEL_MAP((tuple_dt_smoke_test::counted_sample),
+              bit_factory::ml::any_decision_tree::row) {
+  static value<> subscript(tuple_dt_smoke_test::counted_sample const& self,
+                           std::size_t i) {
+    ++*self.reads;
+    return row<>{self.values}[i];
+  };
+};
+
+ANY_MODEL_MAP((tuple_dt_smoke_test::counted_samples),
+              bit_factory::ml::any_decision_tree::sheet) {
+  static anyxx::any_forward_range<row<>, row<>> rows(
+      tuple_dt_smoke_test::counted_samples const& self) {  // NOLINT
+    return self;
+  };
+  static std::string column_header(
+      [[maybe_unused]] tuple_dt_smoke_test::counted_samples const& self,
+      std::size_t index) {
+    return sheet<>{tuple_dt_smoke_test::test_data}.column_header(index);
+  };
+  static std::size_t column_count(
+      [[maybe_unused]] tuple_dt_smoke_test::counted_samples const& self) {
+    return std::tuple_size_v<tuple_dt_smoke_test::sample>;
+  };
+};
+
 namespace {
 namespace tuple_dt_smoke_test {
 
@@ -126,6 +230,16 @@ TEST_CASE("result_counts") {
   CHECK_THAT(impurity, WithinAbs(0.6328125, 0.00000001));
   auto e = any_decision_tree::entropy(counts);
   CHECK_THAT(e, WithinAbs(1.50524081494414785, 0.00000001));
+
+  auto classes = any_decision_tree::encode_classes(sheet, sheet);
+  CHECK(classes.predict_values.size() == 3);
+  auto class_counts = any_decision_tree::class_counts(sheet, classes, sheet);
+  CHECK(class_counts == any_decision_tree::class_counts_t{7, 3, 6});
+  CHECK(classes.to_result_counts(class_counts) == counts);
+  CHECK_THAT(any_decision_tree::class_gini_impurity(class_counts),
+             WithinAbs(impurity, 0.00000001));
+  CHECK_THAT(any_decision_tree::class_entropy(class_counts),
+             WithinAbs(e, 0.00000001));
 }
 
 TEST_CASE("build_tree, classify, prune, classify_with_missing_data") {
@@ -222,6 +336,220 @@ F-> {None: 6, basic: 5}
   }
 }
 
+TEST_CASE("classify_with_missing_data with loggers") {
+  struct counting_logger {
+    std::size_t nodes = 0;
+    void node(any_decision_tree::tree_t const&,
+              any_decision_tree::observation<> const&) {
+      ++nodes;
+    }
+  };
+  static_assert(any_decision_tree::classify_logger<counting_logger>);
+  static_assert(
+      any_decision_tree::classify_logger<any_decision_tree::logger<>>);
+
+  auto const tree = any_decision_tree::build_tree(sheet);
+  for (auto const& p : {probe{"Google", {}, true, {}},
+                        probe{"Google", "France", {}, {}},
+                        probe{"Slashdot", "UK", false, 21}}) {
+    auto const expected = to_string(classify_with_missing_data(tree, p));
+    counting_logger counting;
+    CHECK(to_string(classify_with_missing_data(tree, p, counting)) ==
+          expected);
+    CHECK(counting.nodes > 0);
+
+    std::ostringstream os;
+    any_decision_tree::stream_logger streaming{os};
+    any_decision_tree::logger erased{streaming};
+    CHECK(to_string(classify_with_missing_data(tree, p, erased)) == expected);
+    CHECK(static_cast<std::size_t>(std::ranges::count(os.str(), '\n')) ==
+          counting.nodes);
+  }
+}
+
+TEST_CASE("any_decision_tree build_tree with parallel column search") {
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  thread_pool pool{4};
+  CHECK(to_string(any_decision_tree::build_tree(pool, test_data_sheet)) ==
+        to_string(any_decision_tree::build_tree(test_data_sheet)));
+  CHECK(to_string(any_decision_tree::build_tree(
+            pool, test_data_sheet, test_data_sheet,
+            &any_decision_tree::gini_impurity)) ==
+        to_string(any_decision_tree::build_tree(
+            test_data_sheet, test_data_sheet,
+            &any_decision_tree::gini_impurity)));
+}
+
+TEST_CASE("any_decision_tree build_tree with parallel subtrees") {
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  thread_pool pool{4};
+  auto expected = to_string(any_decision_tree::build_tree(test_data_sheet));
+  CHECK(to_string(any_decision_tree::build_tree(
+            parallel_build_t{
+                .pool = pool, .columns_cutoff = 2, .subtrees_cutoff = 2},
+            test_data_sheet)) == expected);
+  CHECK(to_string(any_decision_tree::build_tree(
+            parallel_build_t{.pool = pool, .subtrees_cutoff = 8},
+            test_data_sheet)) == expected);
+}
+
+TEST_CASE("any_decision_tree build_tree and prune with a memory resource") {
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  std::pmr::monotonic_buffer_resource arena;
+  auto tree = any_decision_tree::build_tree(&arena, test_data_sheet);
+  CHECK(to_string(tree) ==
+        to_string(any_decision_tree::build_tree(test_data_sheet)));
+  CHECK(std::get<any_decision_tree::children_t>(tree.node_data)
+            .true_path.get_deleter()
+            .resource == &arena);
+  CHECK(to_string(any_decision_tree::prune(&arena, tree, 1.0)) ==
+        to_string(any_decision_tree::prune(
+            any_decision_tree::build_tree(test_data_sheet), 1.0)));
+}
+
+TEST_CASE("any_decision_tree model file") {
+  using namespace std::string_literals;
+
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  auto tree = any_decision_tree::build_tree(test_data_sheet);
+  auto const bytes =
+      model_file::serialize(any_decision_tree::to_model(tree));
+  model_file::model_view const view{bytes};
+  CHECK(view.class_count() == 3);
+  for (auto const& [referrer, location, faq, pages, service] : test_data) {
+    auto const p = probe{referrer, location, faq, pages};
+    CHECK(to_string(any_decision_tree::classify(view, p)) ==
+          to_string(classify(tree, p)));
+  }
+  CHECK(any_decision_tree::classify(view, probe{"Google"s, {}, true, {}})
+            .empty());
+  CHECK(to_string(any_decision_tree::classify(
+            view, probe{"(direct)"s, "USA"s, true, 5})) == "{basic: 4}");
+}
+
+TEST_CASE("any_decision_tree generate_header") {
+  std::stringstream header;
+  any_decision_tree::generate_header(
+      any_decision_tree::build_tree(any_decision_tree::sheet{test_data}),
+      header, "smoke_tree");
+  auto const text = header.str();
+  CHECK(text.contains("predict_values{std::string_view{\"None\"}, "
+                      "std::string_view{\"Premium\"}, "
+                      "std::string_view{\"basic\"}};"));
+  CHECK(text.contains(R"(  if (!get<0>(observation)) return 0;
+  if (*get<0>(observation) == std::string_view{"Google"}) {
+    if (!get<3>(observation)) return 0;
+    if (*get<3>(observation) >= 21) {)"));
+  CHECK(text.contains("if (*get<2>(observation) != false) {"));
+}
+
+TEST_CASE("any_decision_tree build_tree with an observer") {
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  build_statistics statistics;
+  auto const tree = any_decision_tree::build_tree(statistics, test_data_sheet);
+  CHECK(to_string(tree) ==
+        to_string(any_decision_tree::build_tree(test_data_sheet)));
+  auto const levels = statistics.levels();
+  REQUIRE(levels.size() == 5);
+  CHECK(levels[0].nodes == 1);
+  CHECK(levels[0].rows == test_data.size());
+  CHECK(levels[0].candidates == 5 + 4 + 2 + 6);
+  CHECK(statistics.totals().nodes == 13);
+  CHECK(statistics.totals().leaves == 7);
+
+  thread_pool pool{4};
+  build_statistics parallel;
+  CHECK(to_string(any_decision_tree::build_tree(
+            parallel, parallel_build_t{.pool = pool, .subtrees_cutoff = 8},
+            test_data_sheet)) == to_string(tree));
+  CHECK(parallel.totals().nodes == 13);
+  CHECK(parallel.totals().candidates == statistics.totals().candidates);
+}
+
+TEST_CASE("build_tree on column buffers") {
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  auto const expected = any_decision_tree::build_tree(test_data_sheet);
+  columnar_samples const columnar{test_data};
+  any_decision_tree::sheet<> const columnar_sheet = columnar;
+  auto const tree = any_decision_tree::build_tree(columnar_sheet);
+  CHECK(to_string(tree) == to_string(expected));
+  for (auto const& [referrer, location, faq, pages, service] : test_data) {
+    auto const p = probe{referrer, location, faq, pages};
+    CHECK(to_string(classify(tree, p)) == to_string(classify(expected, p)));
+  }
+
+  thread_pool pool{4};
+  CHECK(to_string(any_decision_tree::build_tree(
+            parallel_build_t{.pool = pool, .subtrees_cutoff = 4},
+            columnar_sheet)) == to_string(expected));
+  build_statistics statistics, columnar_statistics;
+  CHECK(to_string(any_decision_tree::build_tree(columnar_statistics,
+                                                columnar_sheet)) ==
+        to_string(any_decision_tree::build_tree(statistics, test_data_sheet)));
+  CHECK(columnar_statistics.totals().candidates ==
+        statistics.totals().candidates);
+}
+
+TEST_CASE("build_tree on boxed columns") {
+  boxed_samples boxed;
+  for (auto const& [referrer, location, faq, pages, service] : test_data)
+    boxed.emplace_back(referrer, location, faq, static_cast<float>(pages),
+                       service);
+  any_decision_tree::sheet<> const boxed_sheet = boxed;
+  auto const expected = to_string(any_decision_tree::build_tree(sheet));
+  CHECK(to_string(any_decision_tree::build_tree(boxed_sheet)) == expected);
+  auto const gini = &any_decision_tree::class_gini_impurity;
+  CHECK(to_string(any_decision_tree::build_tree(boxed_sheet, boxed_sheet,
+                                                gini)) ==
+        to_string(any_decision_tree::build_tree(sheet, sheet, gini)));
+}
+
+TEST_CASE("build_tree reads every cell once") {
+  std::size_t reads = 0;
+  counted_samples counted;
+  for (auto const& values : test_data)
+    counted.push_back({.values = values, .reads = &reads});
+  any_decision_tree::sheet<> const counted_sheet = counted;
+  auto const expected = to_string(any_decision_tree::build_tree(sheet));
+  auto const cells = test_data.size() * std::tuple_size_v<sample>;
+  CHECK(to_string(any_decision_tree::build_tree(counted_sheet)) == expected);
+  CHECK(reads == cells);
+
+  reads = 0;
+  thread_pool pool{4};
+  CHECK(to_string(any_decision_tree::build_tree(
+            parallel_build_t{.pool = pool, .subtrees_cutoff = 4},
+            counted_sheet)) == expected);
+  CHECK(reads == cells);
+}
+
+TEST_CASE("lower") {
+  using namespace std::string_literals;
+  using model_file::tag_t;
+
+  auto test_data_sheet = any_decision_tree::sheet{test_data};
+  auto tree = any_decision_tree::build_tree(test_data_sheet);
+  auto const lowered = any_decision_tree::lower(
+      tree, {tag_t::string, tag_t::string, tag_t::boolean, tag_t::integer});
+  CHECK(lowered.class_count() == 3);
+  for (auto const& [referrer, location, faq, pages, service] : test_data) {
+    auto const p = probe{referrer, location, faq, pages};
+    CHECK(to_string(any_decision_tree::classify(lowered, p)) ==
+          to_string(classify(tree, p)));
+    CHECK(std::ranges::equal(
+        any_decision_tree::classify_counts(lowered, p),
+        lowered.classify(any_decision_tree::encode(lowered, p))));
+  }
+  CHECK(any_decision_tree::classify(lowered, probe{"Google"s, {}, true, {}})
+            .empty());
+  CHECK(to_string(any_decision_tree::classify(
+            lowered, probe{"(direct)"s, "USA"s, true, 5})) == "{basic: 4}");
+  CHECK_THROWS_AS(
+      any_decision_tree::lower(tree, {tag_t::string, tag_t::string,
+                                      tag_t::boolean, tag_t::string}),
+      std::invalid_argument);
+}
+
 }  // namespace tuple_dt_smoke_test
 }  // namespace
 
@@ -1,6 +1,48 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit_factory/ml/build_observer.hpp>
 #include <bit_factory/ml/decision_tree.hpp>
+#include <bit_factory/ml/dictionary_encoding.hpp>
+#include <bit_factory/ml/forest.hpp>
+#include <bit_factory/ml/lowered_tree.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+#include <span>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using modulo_tree =
+    bit_factory::ml::decision_tree<bit_factory::ml::array_sheet<int, 3>>;
+
+// count rows of three modulo columns, the class follows the first and the
+// last column.
+modulo_tree::rows_t modulo_samples(int count) {
+    modulo_tree::rows_t samples;
+    for (int i = 0; i < count; ++i)
+        samples.push_back({{i % 7, i % 11, i % 5}, (i % 7 + i % 5) % 3});
+    return samples;
+}
+
+// The observations of modulo_samples(count).
+std::vector<modulo_tree::observation_t> modulo_observations(int count) {
+    std::vector<modulo_tree::observation_t> observations;
+    for (int i = 0; i < count; ++i)
+        observations.push_back({i % 7, i % 11, i % 5});
+    return observations;
+}
+}  // namespace
 
 TEST_CASE("build_tree1") {
   using namespace bit_factory;
@@ -76,4 +118,794 @@ TEST_CASE("classify empty node") {
     const auto result = decision_tree::to_string(decision_tree::classify(tree, observation));
     CHECK(result == "{}");
     CHECK(!tree);
-}
\ No newline at end of file
+}
+TEST_CASE("find_best_gain from column counts") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 2>>;
+    const decision_tree::rows_t samples{
+        {{1, 7}, 0}, {{2, 7}, 0}, {{2, 8}, 0}, {{3, 8}, 1},
+        {{4, 7}, 1}, {{4, 8}, 1}, {{5, 7}, 1}};
+    const auto rows = decision_tree::get_pointer_to_rows(samples);
+
+    const auto classes = decision_tree::encode_classes(rows);
+    CHECK(classes.predict_values == std::vector{0, 1});
+    auto counts = decision_tree::column_counts<0>(classes, rows);
+    CHECK(counts.size() == 5);
+    CHECK(counts[2] == decision_tree::class_counts_t{2, 0});
+    CHECK(decision_tree::to_string(classes.to_result_counts(counts[4])) ==
+          "{1: 2}");
+
+    auto best_gain = decision_tree::find_best_gain<0>(
+        rows, {.gain = 0.0, .criteria = {}, .split_sets = {}},
+        decision_tree::entropy(decision_tree::result_counts(rows)),
+        &decision_tree::entropy);
+    CHECK(best_gain.criteria.column == 0);
+    CHECK(std::get<int>(best_gain.criteria.value) == 3);
+    CHECK(best_gain.split_sets[0].size() == 4);
+    CHECK(best_gain.split_sets[1].size() == 3);
+
+    auto buffer = rows;
+    auto split_rows = decision_tree::partition(buffer, best_gain.criteria);
+    CHECK(split_rows[0].size() == 4);
+    CHECK(split_rows[1].size() == 3);
+    CHECK(split_rows[0].data() == buffer.data());
+    CHECK(std::ranges::all_of(split_rows[0], [](auto const* row) {
+        return row->first[0] >= 3;
+    }));
+    CHECK(std::ranges::none_of(split_rows[1], [](auto const* row) {
+        return row->first[0] >= 3;
+    }));
+}
+
+TEST_CASE("build_tree_presorted") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 2>>;
+    const decision_tree::rows_t samples{
+        {{1, 7}, 0}, {{2, 7}, 0}, {{2, 8}, 0}, {{3, 8}, 1}, {{4, 7}, 1},
+        {{4, 8}, 0}, {{5, 7}, 1}, {{5, 9}, 2}, {{1, 9}, 2}, {{3, 7}, 1}};
+
+    auto attribute_lists = decision_tree::presort(samples);
+    CHECK(attribute_lists[0] ==
+          decision_tree::row_indices_t{0, 8, 1, 2, 3, 9, 4, 5, 6, 7});
+    CHECK(attribute_lists[1] ==
+          decision_tree::row_indices_t{0, 1, 4, 6, 9, 2, 3, 5, 7, 8});
+
+    auto tree = decision_tree::build_tree_presorted(samples);
+    CHECK(to_string(tree) == to_string(decision_tree::build_tree(samples)));
+}
+
+TEST_CASE("build_tree_binned") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 2>>;
+    const decision_tree::rows_t samples{
+        {{1, 7}, 0}, {{2, 7}, 0}, {{2, 8}, 0}, {{3, 8}, 1}, {{4, 7}, 1},
+        {{4, 8}, 0}, {{5, 7}, 1}, {{5, 9}, 2}, {{1, 9}, 2}, {{3, 7}, 1}};
+
+    auto binned = decision_tree::encode_binned_rows(samples, 2);
+    CHECK(std::get<0>(binned.bin_values) == std::vector{1, 3});
+    CHECK(std::get<1>(binned.bin_values) == std::vector{7, 8});
+    CHECK(binned.bins[0] ==
+          std::vector<decision_tree::bin_t>{0, 0, 0, 1, 1, 1, 1, 1, 0, 1});
+    CHECK(binned.bins[1] ==
+          std::vector<decision_tree::bin_t>{0, 0, 1, 1, 0, 1, 0, 1, 1, 0});
+
+    CHECK(to_string(decision_tree::build_tree_binned(samples)) ==
+          to_string(decision_tree::build_tree(samples)));
+    CHECK(to_string(decision_tree::build_tree_binned(
+              samples, 255, &decision_tree::class_gini_impurity)) ==
+          to_string(decision_tree::build_tree(
+              samples, &decision_tree::class_gini_impurity)));
+}
+
+TEST_CASE("build_tree and prune with a memory resource") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 2>>;
+    const decision_tree::rows_t samples{
+        {{1, 7}, 0}, {{2, 7}, 0}, {{2, 8}, 0}, {{3, 8}, 1}, {{4, 7}, 1},
+        {{4, 8}, 0}, {{5, 7}, 1}, {{5, 9}, 2}, {{1, 9}, 2}, {{3, 7}, 1}};
+
+    std::pmr::monotonic_buffer_resource arena;
+    auto const tree = decision_tree::build_tree(&arena, samples);
+    CHECK(to_string(tree) == to_string(decision_tree::build_tree(samples)));
+    auto const& children = std::get<decision_tree::children_t>(tree.node_data);
+    CHECK(children.true_path.get_deleter().resource == &arena);
+
+    auto const pruned = decision_tree::prune(&arena, tree, 0.5);
+    CHECK(to_string(pruned) ==
+          to_string(decision_tree::prune(decision_tree::build_tree(samples),
+                                         0.5)));
+    auto const* leaf = &pruned;
+    while (auto const* node_children =
+               std::get_if<decision_tree::children_t>(&leaf->node_data))
+        leaf = node_children->false_path.get();
+    CHECK(std::get<decision_tree::result_counts_t>(leaf->node_data)
+              .get_allocator()
+              .resource() == &arena);
+}
+
+TEST_CASE("compile and classify") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 2>>;
+    const decision_tree::rows_t samples{
+        {{1, 7}, 0}, {{2, 7}, 0}, {{2, 8}, 0}, {{3, 8}, 1}, {{4, 7}, 1},
+        {{4, 8}, 0}, {{5, 7}, 1}, {{5, 9}, 2}, {{1, 9}, 2}, {{3, 7}, 1}};
+    auto tree = decision_tree::build_tree(samples);
+    auto compiled = decision_tree::compile(tree);
+    CHECK(compiled.columns.size() == 4);
+    CHECK(compiled.leaves.size() == 6);
+
+    for (auto const& [observation, predict] : samples) {
+        const decision_tree::observation_t probe{observation[0],
+                                                 observation[1]};
+        CHECK(decision_tree::classify(compiled, probe) ==
+              decision_tree::classify(tree, probe));
+    }
+    decision_tree::observation_t missing_x0{};
+    missing_x0[1] = 9;
+    CHECK(decision_tree::classify(compiled, missing_x0) ==
+          decision_tree::result_counts_t{{2, 2}});
+    missing_x0[1] = 7;
+    CHECK(decision_tree::classify(compiled, missing_x0).empty());
+    CHECK(decision_tree::classify(decision_tree::compile({}), {1, 7}).empty());
+}
+
+TEST_CASE("build_tree with parallel column search") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 3>>;
+    const decision_tree::rows_t samples{
+        {{1, 7, 1}, 0}, {{2, 7, 2}, 0}, {{2, 8, 1}, 0}, {{3, 8, 2}, 1},
+        {{4, 7, 1}, 1}, {{4, 8, 2}, 0}, {{5, 7, 1}, 1}, {{5, 9, 2}, 2},
+        {{1, 9, 1}, 2}, {{3, 7, 2}, 1}, {{3, 9, 2}, 1}, {{1, 8, 1}, 0}};
+
+    ml::thread_pool pool{4};
+    CHECK(to_string(decision_tree::build_tree(pool, samples)) ==
+          to_string(decision_tree::build_tree(samples)));
+    CHECK(to_string(decision_tree::build_tree(
+              pool, samples, &decision_tree::gini_impurity)) ==
+          to_string(decision_tree::build_tree(samples,
+                                              &decision_tree::gini_impurity)));
+}
+
+TEST_CASE("build_tree with parallel subtrees") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 3>>;
+    auto const samples = modulo_samples(200);
+
+    ml::thread_pool pool{4};
+    auto expected = to_string(decision_tree::build_tree(samples));
+    CHECK(to_string(decision_tree::build_tree(pool, 16, samples)) == expected);
+    CHECK(to_string(decision_tree::build_tree(pool, 1000, samples)) ==
+          expected);
+}
+
+TEST_CASE("wait_guard") {
+    using namespace std::chrono_literals;
+    bit_factory::ml::thread_pool pool{2};
+    std::atomic<bool> finished = false;
+    try {
+        auto task = pool.submit([&] {
+            std::this_thread::sleep_for(20ms);
+            finished = true;
+        });
+        bit_factory::ml::wait_guard const guard{pool, task};
+        throw std::runtime_error("inline path");
+    } catch (std::runtime_error const&) {
+        CHECK(finished);
+    }
+
+    std::atomic<int> finished_tasks = 0;
+    try {
+        std::vector<std::future<void>> tasks;
+        bit_factory::ml::wait_guard const guard{pool, tasks};
+        tasks.push_back(
+            pool.submit([] { throw std::runtime_error("first task"); }));
+        for (int i = 0; i < 3; ++i)
+            tasks.push_back(pool.submit([&] {
+                std::this_thread::sleep_for(20ms);
+                ++finished_tasks;
+            }));
+        for (auto& task : tasks) pool.get(task);
+    } catch (std::runtime_error const&) {
+        CHECK(finished_tasks == 3);
+    }
+}
+
+TEST_CASE("classify_batch") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 3>>;
+    auto const samples = modulo_samples(300);
+    auto observations = modulo_observations(300);
+    observations[5][0].reset();
+    auto const tree = decision_tree::compile(decision_tree::build_tree(samples));
+    CHECK(tree.predict_values == std::vector{0, 1, 2});
+
+    std::vector<std::size_t> leaves(observations.size());
+    decision_tree::classify_batch(tree, observations, std::span{leaves});
+    std::vector<double> counts(observations.size() * 3);
+    decision_tree::classify_batch(tree, observations, std::span{counts});
+    for (std::size_t i = 0; i < observations.size(); ++i) {
+        CHECK(leaves[i] == decision_tree::classify_leaf(tree, observations[i]));
+        for (std::size_t c = 0; c < 3; ++c) {
+            auto const& expected = decision_tree::classify(tree, observations[i]);
+            auto found = expected.find(static_cast<int>(c));
+            CHECK(counts[i * 3 + c] ==
+                  (found == expected.end() ? 0.0 : found->second));
+        }
+    }
+    CHECK(leaves[5] == 0);
+
+    ml::thread_pool pool{4};
+    std::vector<double> parallel_counts(counts.size());
+    decision_tree::classify_batch(pool, tree, observations,
+                                  std::span{parallel_counts});
+    CHECK(parallel_counts == counts);
+    std::vector<std::size_t> parallel_leaves(leaves.size());
+    decision_tree::classify_batch(pool, tree, observations,
+                                  std::span{parallel_leaves});
+    CHECK(parallel_leaves == leaves);
+}
+
+namespace {
+constexpr const char* column_labels[] = {"referrer", "read FAQ", "pages",
+                                         "service"};
+}
+
+TEST_CASE("column_sheet") {
+    using namespace bit_factory;
+    using tuple_tree = ml::decision_tree<
+        ml::tulpe_sheet<column_labels, std::string, bool, int, std::string>>;
+    using column_sheet =
+        ml::column_sheet<column_labels, std::string, bool, int, std::string>;
+    using column_tree = ml::decision_tree<column_sheet>;
+    const tuple_tree::rows_t samples{{"Slashdot", true, 19, "None"},
+                                     {"Slashdot", false, 21, "None"},
+                                     {"Kiwitobes", true, 23, "basic"},
+                                     {"Kiwitobes", false, 19, "None"},
+                                     {"Google", true, 23, "Premium"},
+                                     {"Google", false, 21, "Premium"},
+                                     {"Google", false, 18, "None"},
+                                     {"Digg", true, 12, "basic"},
+                                     {"Digg", true, 24, "basic"}};
+
+    auto const columns = column_sheet::to_columns(samples);
+    CHECK(std::get<2>(columns) ==
+          std::vector{19, 21, 23, 19, 23, 21, 18, 12, 24});
+    auto const rows = column_sheet::rows(columns);
+    CHECK(rows.size() == samples.size());
+    CHECK(column_sheet::get_observation_value<0>(rows[2]) == "Kiwitobes");
+    CHECK(column_sheet::get_predict_value(rows[4]) == "Premium");
+
+    auto const tree = column_tree::build_tree(rows);
+    CHECK(to_string(tree) == to_string(tuple_tree::build_tree(samples)));
+    CHECK(column_tree::to_string(column_tree::classify(
+              tree, {std::string{"Google"}, true, 23})) == "{Premium: 2}");
+}
+
+TEST_CASE("packed_observation") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 3>>;
+    using packed_t = decision_tree::sheet_t::packed_observation_t;
+    static_assert(sizeof(ml::array_sheet<double, 64>::packed_observation_t) ==
+                  64 * sizeof(double) + sizeof(std::uint64_t));
+    static_assert(
+        ml::array_sheet<double, 65>::packed_observation_t{}.missing.size() == 2);
+
+    auto const samples = modulo_samples(300);
+    auto observations = modulo_observations(300);
+    observations[5][0].reset();
+    observations[6][1].reset();
+    observations[6][2].reset();
+    std::vector<packed_t> packed;
+    for (auto const& observation : observations)
+        packed.push_back(packed_t::pack(observation));
+    CHECK(packed[5].is_missing(0));
+    CHECK(!packed[5].is_missing(1));
+    CHECK(!packed[5].complete());
+    CHECK(packed[7].complete());
+    CHECK(packed[7].values == std::array{0, 7, 2});
+
+    auto const tree = decision_tree::build_tree(samples);
+    auto const compiled = decision_tree::compile(tree);
+    for (std::size_t i = 0; i < observations.size(); ++i) {
+        if (packed[i].complete())
+            CHECK(decision_tree::classify(tree, packed[i]) ==
+                  decision_tree::classify(tree, observations[i]));
+        CHECK(decision_tree::classify_leaf(compiled, packed[i]) ==
+              decision_tree::classify_leaf(compiled, observations[i]));
+        CHECK(decision_tree::classify_with_missing_data(tree, packed[i]) ==
+              decision_tree::classify_with_missing_data(tree, observations[i]));
+        CHECK(decision_tree::classify_with_missing_data(compiled, packed[i]) ==
+              decision_tree::classify_with_missing_data(compiled,
+                                                        observations[i]));
+    }
+
+    std::vector<double> counts(observations.size() * 3);
+    decision_tree::classify_batch(compiled, observations, std::span{counts});
+    std::vector<double> packed_counts(counts.size());
+    decision_tree::classify_batch(compiled, packed, std::span{packed_counts});
+    CHECK(packed_counts == counts);
+    ml::thread_pool pool{4};
+    std::vector<std::size_t> leaves(observations.size());
+    decision_tree::classify_batch(pool, compiled, observations,
+                                  std::span{leaves});
+    std::vector<std::size_t> packed_leaves(leaves.size());
+    decision_tree::classify_batch(pool, compiled, std::span{packed},
+                                  std::span{packed_leaves});
+    CHECK(packed_leaves == leaves);
+    CHECK(decision_tree::known_columns(packed[6]) ==
+          decision_tree::known_columns(observations[6]));
+    using wide_tree = ml::decision_tree<ml::array_sheet<int, 65>>;
+    wide_tree::sheet_t::packed_observation_t wide;
+    wide.set_missing(64);
+    CHECK(wide_tree::known_columns(wide).count() == 64);
+    CHECK(!wide_tree::known_columns(wide).test(64));
+
+    using forest = ml::forest<ml::array_sheet<int, 3>>;
+    auto const trees = forest::train(pool, samples, {.tree_count = 8});
+    for (std::size_t i = 0; i < observations.size(); ++i)
+        CHECK(trees.classify(packed[i]) == trees.classify(observations[i]));
+    std::vector<double> votes(observations.size() * 3);
+    trees.classify_batch(observations, votes);
+    std::vector<double> packed_votes(votes.size());
+    trees.classify_batch(pool, packed, packed_votes);
+    CHECK(packed_votes == votes);
+
+    using tuple_tree = ml::decision_tree<
+        ml::tulpe_sheet<column_labels, std::string, bool, int, std::string>>;
+    const tuple_tree::rows_t tuple_samples{{"Slashdot", true, 19, "None"},
+                                           {"Slashdot", false, 21, "None"},
+                                           {"Kiwitobes", true, 23, "basic"},
+                                           {"Google", true, 23, "Premium"},
+                                           {"Google", false, 18, "None"},
+                                           {"Digg", true, 24, "basic"}};
+    auto const referrer_tree = tuple_tree::build_tree(tuple_samples);
+    tuple_tree::sheet_t::packed_observation_t probe{
+        .values = {"Google", false, 0}, .missing = {}};
+    probe.set_missing(2);
+    CHECK(tuple_tree::classify_with_missing_data(referrer_tree, probe) ==
+          tuple_tree::classify_with_missing_data(
+              referrer_tree, {std::string{"Google"}, false, {}}));
+    probe.set_missing(2, false);
+    probe.values = {"Digg", true, 24};
+    CHECK(tuple_tree::to_string(tuple_tree::classify(referrer_tree, probe)) ==
+          "{basic: 2}");
+}
+
+TEST_CASE("model file") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<
+        ml::tulpe_sheet<column_labels, std::string, bool, int, std::string>>;
+    const decision_tree::rows_t samples{{"Slashdot", true, 19, "None"},
+                                        {"Slashdot", false, 21, "None"},
+                                        {"Kiwitobes", true, 23, "basic"},
+                                        {"Kiwitobes", false, 19, "None"},
+                                        {"Google", true, 23, "Premium"},
+                                        {"Google", false, 21, "Premium"},
+                                        {"Google", false, 18, "None"},
+                                        {"Digg", true, 12, "basic"},
+                                        {"Digg", true, 24, "basic"}};
+    auto const tree = decision_tree::build_tree(samples);
+    auto const bytes = ml::model_file::serialize(decision_tree::to_model(tree));
+    ml::model_file::model_view const view{bytes};
+    CHECK(view.class_count() == 3);
+
+    auto const path =
+        std::filesystem::temp_directory_path() / "dt_unit_tests_model.bfdt";
+    ml::model_file::save(path, decision_tree::to_model(tree));
+    {
+        ml::model_file::mapped_model const mapped{path};
+        for (auto const& [referrer, faq, pages, service] : samples) {
+            const decision_tree::observation_t probe{referrer, faq, pages};
+            CHECK(decision_tree::classify(view, probe) ==
+                  decision_tree::classify(tree, probe));
+            CHECK(decision_tree::classify(mapped.view(), probe) ==
+                  decision_tree::classify(tree, probe));
+        }
+        const decision_tree::observation_t missing{{}, true, 23};
+        CHECK(decision_tree::classify(mapped.view(), missing) ==
+              decision_tree::classify(tree, missing));
+    }
+    std::filesystem::remove(path);
+
+    auto corrupt = bytes;
+    corrupt[0] = std::byte{'X'};
+    CHECK_THROWS_AS(ml::model_file::model_view{corrupt}, std::runtime_error);
+    CHECK_THROWS_AS(
+        ml::model_file::model_view{std::span{bytes}.first(bytes.size() - 1)},
+        std::runtime_error);
+
+    // Little endian numbers of size bytes at offset, see model_file.hpp.
+    auto patched = [&](std::size_t offset, std::uint64_t value,
+                       std::size_t size) {
+        auto patched_bytes = bytes;
+        for (std::size_t i = 0; i < size; ++i)
+            patched_bytes[offset + i] = static_cast<std::byte>(value >> (8 * i));
+        return patched_bytes;
+    };
+    std::size_t const node_0 = 32 + 3 * 16;
+    CHECK_THROWS_AS(ml::model_file::model_view{patched(12, 0xffff'ffff, 4)},
+                    std::runtime_error);
+    CHECK_THROWS_AS(ml::model_file::model_view{patched(16, 0xffff'ffff, 4)},
+                    std::runtime_error);
+    CHECK_THROWS_AS(ml::model_file::model_view{patched(node_0 + 4, 3, 4)},
+                    std::runtime_error);
+    CHECK_THROWS_AS(ml::model_file::model_view{patched(node_0 + 8, 0, 4)},
+                    std::runtime_error);
+    CHECK_THROWS_AS(
+        ml::model_file::model_view{patched(40, ~std::uint64_t{0}, 8)},
+        std::runtime_error);
+
+    // Unsigned thresholds above the int64 range have no exact scalar, large
+    // queries still compare above every stored threshold.
+    using unsigned_tree = ml::decision_tree<ml::array_sheet<std::uint64_t, 1>>;
+    auto const large = std::uint64_t{1} << 63;
+    CHECK_THROWS_AS(
+        unsigned_tree::to_model(unsigned_tree::build_tree(
+            unsigned_tree::rows_t{{{1}, 0}, {{large}, 1}, {{large + 1}, 1}})),
+        std::out_of_range);
+    auto const small_tree = unsigned_tree::build_tree(
+        unsigned_tree::rows_t{{{1}, 0}, {{2}, 0}, {{3}, 1}});
+    auto const small_bytes =
+        ml::model_file::serialize(unsigned_tree::to_model(small_tree));
+    ml::model_file::model_view const small_view{small_bytes};
+    const unsigned_tree::observation_t large_probe{large + 1};
+    CHECK(unsigned_tree::classify(small_view, large_probe) ==
+          unsigned_tree::classify(small_tree, large_probe));
+}
+
+TEST_CASE("generate_header") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 1>>;
+    const decision_tree::rows_t samples{{{1}, 0}, {{2}, 0}, {{3}, 1}};
+    std::stringstream header;
+    decision_tree::generate_header(decision_tree::build_tree(samples), header,
+                                   "small_tree");
+    auto const text = header.str();
+    CHECK(text.contains("namespace small_tree {"));
+    CHECK(text.contains(
+        "inline constexpr std::array<std::int64_t, class_count> "
+        "predict_values{0, 1};"));
+    CHECK(text.contains(R"(    leaf_class_counts{{
+        {0.0, 0.0},
+        {0.0, 1.0},
+        {2.0, 0.0},
+    }};)"));
+    CHECK(text.contains(R"(  if (!get<0>(observation)) return 0;
+  if (*get<0>(observation) >= 3) {
+    return 1;
+  } else {
+    return 2;
+  }
+})"));
+
+    CHECK(ml::model_file::detail::cpp_literal(std::string_view{"a\"\\\n"}) ==
+          R"(std::string_view{"a\"\\\012"})");
+    CHECK(ml::model_file::detail::cpp_literal(2.5) == "2.5");
+    CHECK(ml::model_file::detail::cpp_literal(std::int64_t{-3}) == "-3");
+}
+
+TEST_CASE("build_static_tree") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::tulpe_sheet<
+        column_labels, std::string_view, bool, int, std::string_view>>;
+    static constexpr std::array<decision_tree::row_t, 9> samples{{
+        {"Slashdot", true, 19, "None"},
+        {"Slashdot", false, 21, "None"},
+        {"Kiwitobes", true, 23, "basic"},
+        {"Kiwitobes", false, 19, "None"},
+        {"Google", true, 23, "Premium"},
+        {"Google", false, 21, "Premium"},
+        {"Google", false, 18, "None"},
+        {"Digg", true, 12, "basic"},
+        {"Digg", true, 24, "basic"},
+    }};
+    static constexpr auto tree = decision_tree::build_static_tree(samples);
+    static_assert(tree.node_count == 4);
+    static_assert(decision_tree::classify(tree, {"Google", true, 23}).size() ==
+                  1);
+    static_assert(
+        decision_tree::classify(tree, {"Google", true, 23})[0].first ==
+        "Premium");
+    static_assert(decision_tree::classify_leaf(tree, {{}, true, 23}) == 0);
+
+    auto const runtime_tree = decision_tree::build_tree(
+        decision_tree::rows_t{samples.begin(), samples.end()});
+    CHECK(to_string(decision_tree::to_tree(tree)) == to_string(runtime_tree));
+    static constexpr auto gini_tree = decision_tree::build_static_tree(
+        samples, &decision_tree::class_gini_impurity);
+    CHECK(to_string(decision_tree::to_tree(gini_tree)) ==
+          to_string(decision_tree::build_tree(
+              decision_tree::rows_t{samples.begin(), samples.end()},
+              &decision_tree::class_gini_impurity)));
+    for (auto const& [referrer, faq, pages, service] : samples) {
+        const decision_tree::observation_t probe{referrer, faq, pages};
+        auto const result = decision_tree::classify(tree, probe);
+        CHECK(decision_tree::result_counts_t(result.begin(), result.end()) ==
+              decision_tree::classify(runtime_tree, probe));
+    }
+
+    // x[0] >= 1 and x[1] >= 1 tie: their sides hold the class counts
+    // (1, 2, 3) and (3, 2, 1), summed in different orders, so rounding may
+    // pick either of them, at compile time and at run time alike.
+    using tie_tree = ml::decision_tree<ml::array_sheet<int, 2>>;
+    static constexpr std::array<tie_tree::row_t, 12> tie_samples{{
+        {{1, 1}, 0}, {{0, 1}, 0}, {{0, 1}, 0}, {{0, 0}, 0},
+        {{1, 1}, 1}, {{1, 0}, 1}, {{0, 1}, 1}, {{0, 0}, 1},
+        {{1, 0}, 2}, {{1, 0}, 2}, {{1, 1}, 2}, {{0, 0}, 2},
+    }};
+    static constexpr auto static_tie_tree =
+        tie_tree::build_static_tree(tie_samples);
+    auto const tie_root = tie_tree::to_tree(static_tie_tree).column_value;
+    auto const runtime_tie_root =
+        tie_tree::build_tree(
+            tie_tree::rows_t{tie_samples.begin(), tie_samples.end()})
+            .column_value;
+    CHECK(std::get<int>(tie_root.value) == 1);
+    CHECK(std::get<int>(runtime_tie_root.value) == 1);
+    // Both share sweep_column, so gini impurity, which is the same at compile
+    // and run time, resolves the tie alike.
+    static constexpr auto static_gini_tie_tree = tie_tree::build_static_tree(
+        tie_samples, &tie_tree::class_gini_impurity);
+    CHECK(to_string(tie_tree::to_tree(static_gini_tie_tree)) ==
+          to_string(tie_tree::build_tree(
+              tie_tree::rows_t{tie_samples.begin(), tie_samples.end()},
+              &tie_tree::class_gini_impurity)));
+    static constexpr std::array ascending{1.0, 2.0, 3.0};
+    static constexpr std::array descending{3.0, 2.0, 1.0};
+    static_assert(std::abs(tie_tree::class_entropy(ascending) -
+                           tie_tree::class_entropy(descending)) < 1e-15);
+    CHECK(std::abs(tie_tree::class_entropy(ascending) -
+                   tie_tree::class_entropy(descending)) < 1e-15);
+    for (double p : {1.0 / 6, 2.0 / 6, 3.0 / 6, 1.0 / 3, 2.0 / 3})
+        CHECK(std::abs(ml::detail::log2(p) - std::log2(p)) <=
+              4 * std::numeric_limits<double>::epsilon());
+}
+
+TEST_CASE("compiled classify_with_missing_data") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 3>>;
+    auto const samples = modulo_samples(200);
+    auto const tree = decision_tree::build_tree(samples);
+    auto const compiled = decision_tree::compile(tree);
+    CHECK(compiled.subtree_columns.size() == compiled.columns.size());
+    std::vector<double> all_missing(compiled.predict_values.size());
+    decision_tree::classify_with_missing_data(compiled, {}, all_missing);
+    CHECK(all_missing == std::vector<double>(
+                             compiled.missing_class_counts.begin(),
+                             compiled.missing_class_counts.begin() + 3));
+
+    for (int i = 0; i < 77; ++i)
+        for (unsigned missing = 0; missing < 8; ++missing) {
+            decision_tree::observation_t probe{i % 7, i % 11, i % 5};
+            for (std::size_t column = 0; column < 3; ++column)
+                if (missing & (1U << column)) probe[column].reset();
+            CHECK(decision_tree::classify_with_missing_data(compiled, probe) ==
+                  decision_tree::classify_with_missing_data(tree, probe));
+        }
+}
+
+TEST_CASE("dictionary_encoder") {
+    using namespace bit_factory;
+    using encoder_t = ml::dictionary_encoder<column_labels, std::string, bool,
+                                             int, std::string>;
+    using source_tree = encoder_t::source_tree;
+    using encoded_tree = encoder_t::encoded_tree;
+    static_assert(std::same_as<encoded_tree::row_t,
+                               std::tuple<ml::category_t, bool, int,
+                                          std::string>>);
+    const source_tree::rows_t samples{{"Slashdot", true, 19, "None"},
+                                      {"Slashdot", false, 21, "None"},
+                                      {"Kiwitobes", true, 23, "basic"},
+                                      {"Kiwitobes", false, 19, "None"},
+                                      {"Google", true, 23, "Premium"},
+                                      {"Google", false, 21, "Premium"},
+                                      {"Google", false, 18, "None"},
+                                      {"Digg", true, 12, "basic"},
+                                      {"Digg", true, 24, "basic"}};
+
+    encoder_t const encoder{samples};
+    CHECK(encoder.dictionary(0).size() == 4);
+    CHECK(encoder.dictionary(0).find("Google") == ml::category_t{1});
+    CHECK(encoder.dictionary(0).find("AltaVista") ==
+          ml::dictionary_t::unknown);
+    CHECK(encoder.dictionary(0).string(ml::category_t{3}) == "Slashdot");
+
+    auto const tree = encoded_tree::build_tree(encoder.encode(samples));
+    auto const source = source_tree::build_tree(samples);
+    CHECK(to_string(encoder.decode(tree)) == to_string(source));
+    for (auto const& [referrer, faq, pages, service] : samples) {
+        const source_tree::observation_t probe{referrer, faq, pages};
+        CHECK(encoded_tree::classify(tree, encoder.encode(probe)) ==
+              source_tree::classify(source, probe));
+    }
+    const source_tree::observation_t unseen{"AltaVista", true, 23};
+    CHECK(encoded_tree::classify(tree, encoder.encode(unseen)) ==
+          source_tree::classify(source, unseen));
+}
+
+TEST_CASE("build_tree_category_sets") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<
+        ml::tulpe_sheet<column_labels, std::string, bool, int, std::string>>;
+    decision_tree::rows_t samples;
+    for (int i = 0; i < 60; ++i) {
+        std::string const referrer(1, static_cast<char>('a' + i % 6));
+        samples.push_back({referrer, i % 4 == 0, i % 5,
+                           i % 2 == 0 ? "Premium" : "None"});
+    }
+    auto const sets = decision_tree::build_tree_category_sets(samples);
+    auto const chains = decision_tree::build_tree(samples);
+    CHECK(to_string(sets).contains("referrer in {a, c, e}?"));
+    CHECK(to_string(sets).size() < to_string(chains).size());
+    CHECK_THROWS_AS(decision_tree::to_model(sets), std::invalid_argument);
+
+    auto const compiled = decision_tree::compile(sets);
+    for (char referrer = 'a'; referrer <= 'g'; ++referrer)
+        for (int pages = 0; pages < 5; ++pages) {
+            const decision_tree::observation_t probe{
+                std::string(1, referrer), pages % 2 == 0, pages};
+            CHECK(decision_tree::classify(compiled, probe) ==
+                  decision_tree::classify(sets, probe));
+            if (referrer < 'g')
+                CHECK(decision_tree::classify(sets, probe).size() == 1);
+        }
+
+    std::erase_if(samples, [](auto const& row) {
+        return std::get<0>(row) > "c";
+    });
+    CHECK(to_string(decision_tree::build_tree_category_sets(samples)) ==
+          to_string(decision_tree::build_tree(samples)));
+}
+
+TEST_CASE("forest") {
+    using namespace bit_factory;
+    using forest = ml::forest<ml::array_sheet<int, 3>>;
+    using decision_tree = forest::tree;
+    auto const samples = modulo_samples(300);
+    std::vector<forest::observation_t> observations;
+    for (int i = 0; i < 150; ++i)
+        observations.push_back({i % 8, i % 12, i % 6});
+
+    auto const single = forest::train(
+        samples, {.tree_count = 1, .feature_count = 3, .bootstrap = false});
+    auto const tree = decision_tree::build_tree(samples);
+    for (auto const& observation : observations) {
+        auto const counts = decision_tree::classify(tree, observation);
+        auto const total = decision_tree::result_counts_total(counts);
+        auto const votes = single.classify(observation);
+        for (std::size_t id = 0; id < votes.size(); ++id) {
+            auto found = counts.find(single.predict_values()[id]);
+            CHECK(votes[id] ==
+                  (found == counts.end() ? 0.0 : found->second / total));
+        }
+    }
+    auto const compiled = decision_tree::compile(tree);
+    CHECK(single.compiled().subtree_columns == compiled.subtree_columns);
+    CHECK(single.compiled().missing_class_counts ==
+          compiled.missing_class_counts);
+
+    ml::thread_pool pool{4};
+    forest::options_t const options{.tree_count = 16, .seed = 7};
+    auto const sequential = forest::train(samples, options);
+    auto const parallel = forest::train(pool, samples, options);
+    CHECK(parallel.tree_count() == 16);
+    CHECK(parallel.compiled().columns == sequential.compiled().columns);
+    CHECK(std::ranges::equal(parallel.roots(), sequential.roots()));
+
+    auto const class_count = parallel.predict_values().size();
+    std::vector<double> batch(observations.size() * class_count);
+    std::vector<double> pooled(observations.size() * class_count);
+    parallel.classify_batch(observations, batch);
+    parallel.classify_batch(pool, observations, pooled);
+    CHECK(batch == pooled);
+    for (std::size_t i = 0; i < observations.size(); ++i) {
+        auto const votes = sequential.classify(observations[i]);
+        CHECK(std::ranges::equal(
+            votes, std::span{batch}.subspan(i * class_count, class_count)));
+        auto const sum = std::accumulate(votes.begin(), votes.end(), 0.0);
+        CHECK(sum > 0.999);
+        CHECK(sum < 1.001);
+    }
+    CHECK_THROWS_AS(
+        parallel.classify_batch(observations, std::span{batch}.first(3)),
+        std::out_of_range);
+}
+
+TEST_CASE("build_tree with an observer") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<ml::array_sheet<int, 3>>;
+    auto const samples = modulo_samples(300);
+
+    struct recorder {
+        std::vector<ml::build_node_t> nodes;
+        void node(ml::build_node_t const& node) { nodes.push_back(node); }
+    } recorded;
+    auto const tree = decision_tree::build_tree(recorded, samples);
+    CHECK(to_string(tree) == to_string(decision_tree::build_tree(samples)));
+    REQUIRE(!recorded.nodes.empty());
+    CHECK(recorded.nodes.front().depth == 0);
+    CHECK(recorded.nodes.front().rows == samples.size());
+    CHECK(recorded.nodes.front().candidates == 7 + 11 + 5);
+    CHECK(recorded.nodes.front().best_gain > 0.0);
+    CHECK(!recorded.nodes.front().leaf);
+    auto const compiled = decision_tree::compile(tree);
+    CHECK(std::ranges::count_if(recorded.nodes, [](auto const& node) {
+              return !node.leaf;
+          }) == static_cast<std::ptrdiff_t>(compiled.columns.size()));
+    CHECK(std::ranges::count_if(recorded.nodes, [](auto const& node) {
+              return node.leaf;
+          }) == static_cast<std::ptrdiff_t>(compiled.leaves.size() - 1));
+
+    ml::build_statistics statistics;
+    auto const observed = decision_tree::build_tree(statistics, samples);
+    auto const levels = statistics.levels();
+    auto const totals = statistics.totals();
+    CHECK(levels.front().nodes == 1);
+    CHECK(levels.front().rows == samples.size());
+    CHECK(totals.nodes == recorded.nodes.size());
+    for (auto const& level : levels) CHECK(level.rows <= samples.size());
+
+    ml::thread_pool pool{4};
+    ml::build_statistics parallel;
+    auto const parallel_tree = decision_tree::build_tree(
+        parallel, ml::parallel_build_t{.pool = pool, .subtrees_cutoff = 50},
+        samples);
+    CHECK(to_string(parallel_tree) == to_string(tree));
+    CHECK(parallel.totals().nodes == totals.nodes);
+    CHECK(parallel.totals().leaves == totals.leaves);
+    CHECK(parallel.totals().candidates == totals.candidates);
+
+    std::stringstream report;
+    report << statistics;
+    CHECK(report.str().contains("total"));
+}
+
+TEST_CASE("lowered_tree") {
+    using namespace bit_factory;
+    using decision_tree = ml::decision_tree<
+        ml::tulpe_sheet<column_labels, std::string, bool, int, std::string>>;
+    using tag_t = ml::model_file::tag_t;
+    const decision_tree::rows_t samples{{"Slashdot", true, 19, "None"},
+                                        {"Slashdot", false, 21, "None"},
+                                        {"Kiwitobes", true, 23, "basic"},
+                                        {"Kiwitobes", false, 19, "None"},
+                                        {"Google", true, 23, "Premium"},
+                                        {"Google", false, 21, "Premium"},
+                                        {"Google", false, 18, "None"},
+                                        {"Digg", true, 12, "basic"},
+                                        {"Digg", true, 24, "basic"}};
+    auto const tree = decision_tree::build_tree(samples);
+    auto const model = decision_tree::to_model(tree);
+    auto const bytes = ml::model_file::serialize(model);
+    ml::model_file::model_view const view{bytes};
+    auto const lowered =
+        ml::lower(model, {tag_t::string, tag_t::boolean, tag_t::integer});
+    CHECK(lowered.columns.size() == view.node_count());
+    CHECK(lowered.class_count() == view.class_count());
+
+    auto check = [&](decision_tree::observation_t const& probe) {
+        auto const leaf = lowered.classify_leaf(lowered.encode(probe));
+        CHECK(leaf == decision_tree::classify_leaf(view, probe));
+        auto const counts = lowered.class_counts(leaf);
+        for (std::size_t class_id = 0; class_id < counts.size(); ++class_id)
+            CHECK(counts[class_id] == view.leaf_count(leaf, class_id));
+    };
+    for (auto const& [referrer, faq, pages, service] : samples)
+        check({referrer, faq, pages});
+    check({"Yahoo", true, 30});
+    check({{}, true, 23});
+    check({"Google", {}, {}});
+
+    CHECK_THROWS_AS(
+        ml::lower(model, {tag_t::string, tag_t::boolean, tag_t::string}),
+        std::invalid_argument);
+    CHECK_THROWS_AS(ml::lower(model, {tag_t::string}), std::invalid_argument);
+    CHECK_THROWS_AS(lowered.encode(0, std::int64_t{1}), std::invalid_argument);
+    auto const real = ml::lower(model, {tag_t::string, tag_t::boolean,
+                                        tag_t::real});
+    for (auto const& [referrer, faq, pages, service] : samples) {
+        const decision_tree::observation_t probe{referrer, faq, pages};
+        CHECK(real.classify_leaf(real.encode(probe)) ==
+              lowered.classify_leaf(lowered.encode(probe)));
+    }
+}